@@ -0,0 +1,93 @@
+// Crossover between cached and streaming stores for pp::fill and pp::copyto.
+//
+//     g++ -std=c++11 -O2 -march=native -Isrc bench/ndarray-streaming.cpp -o streaming && ./streaming
+//
+// For each output size, the fill and the copy are timed with streaming stores
+// forced on and off, followed by a read of the output (which streaming stores
+// leave out of the cache) and by a read of a small working set (which cached
+// stores evict). Streaming pays off from the size where reading the output
+// costs as much either way; set PP_NDARRAY_STREAMING_THRESHOLD around it.
+
+#include "ndarray-11.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+float touch(const pp::Inner<float, 2>& arr)
+{
+    float sum = 0;
+    for (std::size_t i = 0; i < arr.size(); ++i)
+        for (std::size_t j = 0; j < arr.begin()[i].size(); ++j) sum += arr.begin()[i].begin()[j];
+    return sum;
+}
+
+struct Result
+{
+    double write, output, hot;
+};
+
+Result run(pp::Inner<float, 2>& dst, const pp::Inner<float, 2>& src, const pp::Inner<float, 2>& hot, bool copy, std::size_t threshold, int repeat)
+{
+    pp::set_streaming_threshold(threshold);
+
+    Result best = {1e9, 1e9, 1e9};
+    volatile float sink = 0;
+    for (int r = 0; r < repeat; ++r)
+    {
+        sink = sink + touch(hot);
+
+        Clock::time_point start = Clock::now();
+        if (copy) pp::copyto(dst, src);
+        else pp::fill(dst, static_cast<float>(r));
+        best.write = std::min(best.write, seconds(start));
+
+        start = Clock::now();
+        sink = sink + touch(dst);
+        best.output = std::min(best.output, seconds(start));
+
+        if (copy) pp::copyto(dst, src);
+        else pp::fill(dst, static_cast<float>(r));
+
+        start = Clock::now();
+        sink = sink + touch(hot);
+        best.hot = std::min(best.hot, seconds(start));
+    }
+    return best;
+}
+
+}
+
+int main()
+{
+    const std::size_t cols = 4096;
+    const pp::Inner<float, 2> hot(256, cols, 1.0f);    // 4 MiB working set
+
+    std::printf("%10s %5s | %-21s | %-21s | %-21s\n", "", "", "write GB/s", "read output ms", "read working set ms");
+    std::printf("%10s %5s | %10s %10s | %10s %10s | %10s %10s\n", "size", "op", "cached", "stream", "cached", "stream", "cached", "stream");
+    for (std::size_t mib = 1; mib <= 512; mib *= 2)
+    {
+        const std::size_t rows = (mib << 20) / (cols * sizeof(float));
+        pp::Inner<float, 2> dst(rows, cols, 0.0f);
+        const pp::Inner<float, 2> src(rows, cols, 2.0f);
+        const int repeat = mib <= 64 ? 10 : 3;
+
+        for (int copy = 0; copy < 2; ++copy)
+        {
+            const Result cached = run(dst, src, hot, copy != 0, SIZE_MAX, repeat);
+            const Result stream = run(dst, src, hot, copy != 0, 0, repeat);
+            const double gb = (mib << 20) / 1e9;
+
+            std::printf("%6zu MiB %5s | %10.2f %10.2f | %10.3f %10.3f | %10.3f %10.3f\n", mib, copy ? "copy" : "fill",
+                        gb / cached.write, gb / stream.write, cached.output * 1e3, stream.output * 1e3, cached.hot * 1e3, stream.hot * 1e3);
+        }
+    }
+}
@@ -0,0 +1,19 @@
+#include "ndarray-11.hpp"
+#include <iostream>
+
+int main() {
+    // The type of the elements comes from a configuration
+    pp::ScalarType type = pp::ScalarType::float32;
+
+    pp::AnyArray a(type, {2, 3});
+    pp::fill(a, 1.5);
+
+    // Element-wise operations and reductions dispatch on the type at run time
+    pp::AnyArray b = (a + a).astype(pp::ScalarType::int64);
+    std::cout << pp::scalar_type_name(b.dtype()) << " sum " << pp::sum(b) << std::endl;
+
+    // Back to a typed array, without copying
+    pp::DynArray<std::int64_t>& values = b.as<std::int64_t>();
+    values(1, 2) = -4;
+    std::cout << b << std::endl;
+}
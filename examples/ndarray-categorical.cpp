@@ -0,0 +1,29 @@
+#include "ndarray-11.hpp"
+#include <iostream>
+#include <string>
+
+int main() {
+    pp::Ndarray<std::string[2]> cities = {
+        {"Taipei", "Tainan", "Taipei"},
+        {"Hsinchu", "Taipei", "Tainan"}
+    };
+    pp::Ndarray<int[2]> sales = {{3, 1, 4}, {1, 5, 9}};
+
+    // One byte per element instead of a std::string
+    auto cat = pp::categorical<uint8_t>(cities);
+    // categories: Taipei, Tainan, Hsinchu
+    // codes: [[0, 1, 0], [2, 0, 1]]
+
+    auto counts = cat.value_counts();
+    // [ 3, 2, 1 ]
+
+    size_t taipei = cat.count("Taipei");
+    std::cout << taipei << std::endl;
+    // 3
+
+    auto total = cat.group_sum(sales);
+    // [ 12, 10, 1 ]
+
+    pp::Ndarray<std::string[2]> decoded = cat;
+    // same as cities
+}
@@ -0,0 +1,25 @@
+#include "ndarray-11.hpp"
+#include <cstdint>
+#include <iostream>
+
+int main() {
+    pp::Ndarray<int64_t[1]> sensor = {7, 7, 7, 7, 3, 3, 9, 9, 9, 7};
+
+    // Run-length encoded: 4 runs instead of 10 elements
+    pp::RleArray<int64_t> rle(sensor);
+    int64_t total = rle.sum();                          // 68
+    size_t hits = rle.count_between(5, 8);              // 5
+    pp::RleArray<int64_t> part = rle.slice(3, 7);       // [ 7, 3, 3, 9 ]
+    std::cout << total << " " << hits << " " << part << std::endl;
+
+    // Frame of reference: each block of 128 stores its minimum and 9 bit differences
+    pp::Ndarray<int64_t[1]> timestamps = pp::arange<int64_t>(1700000000, 1700000400, 3);
+    pp::ForArray<int64_t> packed(timestamps);
+    int64_t last = packed.max();                        // 1700000399
+    size_t recent = packed.count_between(1700000300, 1700000400);
+    // 34
+    std::cout << last << " " << recent << std::endl;
+
+    // Decompressed only when assigned
+    pp::Ndarray<int64_t[1]> restored = packed;
+}
@@ -0,0 +1,23 @@
+#include "ndarray-11.hpp"
+#include <iostream>
+
+int main() {
+    // The rank is only known at run time, e.g. when read from a file
+    pp::DynArray<float>::shape_type shape = {2, 3, 4};
+    pp::DynArray<float> volume(shape, 1.0f);
+
+    volume(1, -1, 0) = 5.0f;
+    std::cout << volume.ndim() << " dimensions, sum " << pp::sum(volume) << std::endl;
+
+    // Dispatch once to a fixed rank where the static kernels are needed
+    if (volume.ndim() == 3) {
+        auto fixed = volume.to_ndarray<3>();
+        std::cout << fixed(1, 2, 0) << std::endl;
+    }
+
+    // Arrays of one dimension move their storage in and out
+    pp::Ndarray<double[1]> samples = {0.5, 1.5, 2.5};
+    pp::DynArray<double> flat(std::move(samples));
+    flat.reshape({3, 1});
+    std::cout << flat << std::endl;
+}
@@ -0,0 +1,28 @@
+#include "ndarray-11.hpp"
+#include <cmath>
+
+int main() {
+    pp::Ndarray<double[1]> x = {0, 1, 2, 3};
+    pp::Ndarray<double[1]> y = {0, 1, 2};
+
+    // Nothing is computed nor stored here
+    auto grid = pp::meshgrid(x, y);
+    auto r2 = grid.first * grid.first + grid.second * grid.second;
+    auto r = pp::map([](double v) { return std::sqrt(v); }, r2);
+
+    // Evaluated in one pass when assigned, only the result is stored
+    pp::Ndarray<double[2]> distances = r;
+    // shape: 3x4
+
+    // Outer product, broadcast against a row
+    pp::Ndarray<double[2]> table = pp::outer(y, x) + x.view(pp::newaxis);
+    // [
+    //   [ 0, 1, 2, 3 ],
+    //   [ 0, 2, 4, 6 ],
+    //   [ 0, 3, 6, 9 ]
+    // ]
+
+    // Kronecker product
+    pp::Ndarray<double[1]> k = pp::kron(y, pp::Ndarray<double[1]>{1, 10});
+    // [ 0, 0, 1, 10, 2, 20 ]
+}
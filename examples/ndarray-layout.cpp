@@ -0,0 +1,22 @@
+#include "ndarray-11.hpp"
+#include <iostream>
+
+int main() {
+    pp::Ndarray<float[2]> image(512, 512, 0.0f);
+
+    // Z-order: the 4 neighbours of a pixel are close in memory
+    pp::MortonArray<float, 2> morton(image);
+    float laplacian = morton(9, 10) + morton(11, 10) + morton(10, 9) + morton(10, 11) - 4 * morton(10, 10);
+    std::cout << laplacian << std::endl;
+
+    // Tiles of 64x64 pixels, each tile contiguous
+    pp::TiledArray<float, 64> tiled(image);
+    tiled(100, 200) = 1.0f;
+
+    // Voxels
+    pp::MortonArray<short, 3> voxels(std::array<size_t, 3>{{64, 64, 64}});
+    voxels(1, 2, 3) = 42;
+
+    // Back to row-major
+    pp::Ndarray<float[2]> result = tiled;
+}
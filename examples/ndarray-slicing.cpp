@@ -27,7 +27,7 @@ int main() {
     pp::Range s3("::2");    // start at 0, to the end, step 2
     pp::Range s4(":2");     // start at 0, end to 2, step 1
 
-    // Equivalent to `pp::Range(0, 1, 2, false)`
+    // Equivalent to `pp::Range(0, 1, 2)`
     pp::Range s5("0:1:2");  // start at 0, end to 1, step 2
     
     // 2D Slicing
@@ -40,10 +40,25 @@ int main() {
 
     // 3D Slicing
     // Equivalent to array.slice(s1, s2, s3)
-    auto result3 = array.slice["0:1, 1:, ::2"];
+    auto result3 = array["0:1, 1:, ::2"];
     // pp::Ndarray<int[3]> result3 = {
     //     {
     //         {3, 5}
     //     }
     // };
-}
\ No newline at end of file
+
+    // Slicing without strings
+    // Integers remove their axis, so the result is 2D
+    auto result4 = array(pp::all, 1, pp::range(0, 3, 2));
+    // pp::Ndarray<int[2]> result4 = {
+    //     {3, 5},
+    //     {9, 11}
+    // };
+
+    // Negative indices count from the end
+    auto result5 = array.slice(-1, pp::all, pp::range(-2, 3));
+    // pp::Ndarray<int[2]> result5 = {
+    //     {7, 8},
+    //     {10, 11}
+    // };
+}
@@ -0,0 +1,43 @@
+#include "ndarray-11.hpp"
+#include <iostream>
+
+int main() {
+    pp::Ndarray<int[3]> array = {
+        {
+            {0, 1, 2},
+            {3, 4, 5}
+        },
+        {
+            {6, 7, 8},
+            {9,10,11}
+        },
+    };
+
+    // Views take the same arguments as slicing, but never copy
+    auto column = array.view(pp::all, pp::all, 1);
+    // shape: 2x2
+    // [
+    //   [ 1, 4 ],
+    //   [ 7, 10 ]
+    // ]
+
+    // Writing through a view changes the array
+    column(1, 1) = 100;     // array(1, 1, 1) == 100
+
+    // `pp::newaxis` inserts an axis of length 1
+    auto batch = array.view(pp::newaxis);
+    // shape: 1x2x2x3
+    std::cout << batch.shape()[0] << std::endl;
+
+    // `pp::ellipsis` keeps all the axes which are not given
+    auto last = array.view(pp::ellipsis, -1, pp::newaxis);
+    // shape: 2x2x1
+    std::cout << last(1, 1, 0) << std::endl;     // 11
+
+    // Same with strings, the dimension of the result is given explicitly
+    auto same = array.view<4>("None, ...");
+    std::cout << same(0, 1, 0, 2) << std::endl;  // 8
+
+    // A view is copied only when assigned to an Ndarray
+    pp::Ndarray<int>::dim<2> copied = column;
+}
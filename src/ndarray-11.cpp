@@ -0,0 +1,11 @@
+/**
+ * @file
+ * @brief Explicit instantiations of the common arrays, see @ref instantiation
+ *
+ * Compile this file with the same `PP_NDARRAY_*` macros as the rest of the
+ * program, and define PP_NDARRAY_EXTERN_TEMPLATES in the code including
+ * ndarray-11.hpp so that it uses these instead of its own.
+ */
+
+#define PP_NDARRAY_INSTANTIATE
+#include "ndarray-11.hpp"
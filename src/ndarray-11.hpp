@@ -15,6 +15,75 @@
 #include <string>
 #include <regex>
 #include <array>
+#include <map>
+#include <new>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <iterator>
+
+#if !defined(PP_NDARRAY_NO_EXCEPTIONS) && !defined(__cpp_exceptions) && !defined(__EXCEPTIONS) && !defined(_CPPUNWIND)
+#define PP_NDARRAY_NO_EXCEPTIONS
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PP_NDARRAY_COLD [[noreturn]] __attribute__((noinline, cold))
+#else
+#define PP_NDARRAY_COLD [[noreturn]]
+#endif
+
+#if !defined(PP_NDARRAY_NO_SIMD)
+#if defined(__AVX512F__)
+#define PP_NDARRAY_AVX512
+#endif
+#if defined(__BMI2__)
+#define PP_NDARRAY_BMI2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PP_NDARRAY_SSE2
+#endif
+#endif
+
+#if defined(PP_NDARRAY_AVX512) || defined(PP_NDARRAY_BMI2) || defined(PP_NDARRAY_SSE2)
+#include <immintrin.h>
+#endif
+
+// Eigen/Core on request, see @ref eigen
+#if defined(PP_NDARRAY_EIGEN) && !defined(EIGEN_WORLD_VERSION) && defined(__has_include)
+#if __has_include(<Eigen/Core>)
+#include <Eigen/Core>
+#endif
+#endif
+
+// std::mdspan, or the reference implementation, when available. Define
+// PP_NDARRAY_MDSPAN_NAMESPACE after including another one to use it instead.
+#if !defined(PP_NDARRAY_MDSPAN_NAMESPACE) && defined(__has_include)
+#if __cplusplus > 202002L && __has_include(<mdspan>)
+#include <mdspan>
+#endif
+#if defined(__cpp_lib_mdspan)
+#define PP_NDARRAY_MDSPAN_NAMESPACE std
+#elif __cplusplus >= 201402L && __has_include(<experimental/mdspan>)
+#include <experimental/mdspan>
+#if defined(MDSPAN_IMPL_STANDARD_NAMESPACE)
+#define PP_NDARRAY_MDSPAN_NAMESPACE MDSPAN_IMPL_STANDARD_NAMESPACE
+#else
+#define PP_NDARRAY_MDSPAN_NAMESPACE std::experimental
+#endif
+#endif
+#endif
 
 namespace pp
 {
@@ -49,297 +118,6517 @@ namespace pp
     { using type = index_sequence<Next ... >; };                                      /**< @copydoc index_sequence */
     template <std::size_t N>
     using make_index_sequence = typename indexSequenceHelper<N>::type;
+
+    /// C++11 std::void_t helper, `make_void<Ts...>::type` is void
+    template<typename...> struct make_void { using type = void; };
     
     /** @} */
 
-    /// Class for slicing index
-    struct Range
+#if defined(PP_NDARRAY_MDSPAN_NAMESPACE)
+    /// A row-major mdspan of `dim` run-time extents, see @ref buffer
+    template<typename T, std::size_t dim>
+    using mdspan = PP_NDARRAY_MDSPAN_NAMESPACE::mdspan<T, PP_NDARRAY_MDSPAN_NAMESPACE::dextents<std::size_t, dim>>;
+
+    /// An mdspan of `dim` run-time extents with a stride per axis
+    template<typename T, std::size_t dim>
+    using strided_mdspan = PP_NDARRAY_MDSPAN_NAMESPACE::mdspan<T, PP_NDARRAY_MDSPAN_NAMESPACE::dextents<std::size_t, dim>,
+                                                               PP_NDARRAY_MDSPAN_NAMESPACE::layout_stride>;
+#endif
+
+    /**
+     * @addtogroup error Error handling
+     * How errors are reported, with or without exceptions.
+     *
+     * By default, errors throw std::out_of_range or std::invalid_argument.
+     * When exceptions are disabled (`-fno-exceptions`, or defining
+     * PP_NDARRAY_NO_EXCEPTIONS), an error calls the handler set with
+     * set_error_handler() and then aborts; the default handler prints the
+     * message to stderr.
+     *
+     * The `try_` functions report errors in their result instead, as an
+     * Expected which holds either a value or an Error.
+     * @{
+     */
+
+    /// Kind of error, after the exception thrown for it
+    enum class Error
     {
-        int start;
-        int stop;
-        int step;
-        bool has_stop;  ///< Flag to check if stop is given
+        none,
+        out_of_range,
+        invalid_argument
+    };
+
+    /// Called with the kind of error and a message, before aborting when exceptions are disabled
+    using error_handler = void (*)(Error, const char*);
+
+    namespace detail
+    {
+        inline void printError(Error, const char* message)
+        {
+            std::fputs("pp::Ndarray error: ", stderr);
+            std::fputs(message, stderr);
+            std::fputs("\n", stderr);
+        }
+
+        inline error_handler& errorHandler()
+        {
+            static error_handler handler = printError;
+            return handler;
+        }
+
+        template<typename Exception> struct error_of;
+        template<> struct error_of<std::out_of_range> : std::integral_constant<Error, Error::out_of_range> {};
+        template<> struct error_of<std::invalid_argument> : std::integral_constant<Error, Error::invalid_argument> {};
+
+        /// Report an error: throw `Exception`, or call the handler and abort without exceptions
+        template<typename Exception>
+        PP_NDARRAY_COLD void raise(const char* message)
+        {
+#if defined(PP_NDARRAY_NO_EXCEPTIONS)
+            errorHandler()(error_of<Exception>::value, message);
+            std::abort();
+#else
+            throw Exception(message);
+#endif
+        }
+
+        /// Report `error` like raise()
+        PP_NDARRAY_COLD inline void raise(Error error, const char* message)
+        {
+            if (error == Error::out_of_range) raise<std::out_of_range>(message);
+            raise<std::invalid_argument>(message);
+        }
+    }
+
+    /// Set the handler called on errors when exceptions are disabled, returns the previous one
+    inline error_handler set_error_handler(error_handler handler)
+    {
+        const error_handler previous = detail::errorHandler();
+        detail::errorHandler() = handler ? handler : detail::printError;
+        return previous;
+    }
+
+    /**
+     * Either a value or the Error which prevented computing it.
+     *
+     * `T` may be a reference, to report errors of element access.
+     */
+    template<typename T>
+    class Expected
+    {
+    public:
+        Expected(const T& value) : error_(Error::none) { new (&value_) T(value); }
+        Expected(T&& value) : error_(Error::none) { new (&value_) T(std::move(value)); }
+        Expected(Error error) : error_(error) {}
+
+        Expected(const Expected& other) : error_(other.error_)
+        {
+            if (has_value()) new (&value_) T(other.value_);
+        }
+
+        Expected& operator=(const Expected& other)
+        {
+            if (this == &other) return *this;
+
+            if (has_value()) value_.~T();
+            error_ = other.error_;
+            if (has_value()) new (&value_) T(other.value_);
+            return *this;
+        }
+
+        ~Expected()
+        {
+            if (has_value()) value_.~T();
+        }
+
+        bool has_value() const { return error_ == Error::none; }
+        explicit operator bool() const { return has_value(); }
+
+        /// Error::none if there is a value
+        Error error() const { return error_; }
+
+        /// The value, reports the error like a throwing function if there is none
+        T& value()
+        {
+            if (!has_value()) detail::raise(error_, "Expected has no value");
+            return value_;
+        }
+
+        const T& value() const
+        {
+            if (!has_value()) detail::raise(error_, "Expected has no value");
+            return value_;
+        }
+
+        T& operator*() { return value_; }
+        const T& operator*() const { return value_; }
+        T* operator->() { return &value_; }
+        const T* operator->() const { return &value_; }
+
+    private:
+        Error error_;
+        union { T value_; };
+    };
+
+    template<typename T>
+    class Expected<T&>
+    {
+    public:
+        Expected(T& value) : error_(Error::none), value_(&value) {}
+        Expected(Error error) : error_(error), value_(nullptr) {}
+
+        bool has_value() const { return error_ == Error::none; }
+        explicit operator bool() const { return has_value(); }
+
+        /// Error::none if there is a value
+        Error error() const { return error_; }
+
+        /// The value, reports the error like a throwing function if there is none
+        T& value() const
+        {
+            if (!has_value()) detail::raise(error_, "Expected has no value");
+            return *value_;
+        }
+
+        T& operator*() const { return *value_; }
+        T* operator->() const { return value_; }
+
+    private:
+        Error error_;
+        T* value_;
+    };
+
+    /** @} */
+
+
+    /**
+     * @addtogroup metrics Metrics
+     * Counters of the library, exported in the Prometheus text format.
+     *
+     * Each thread counts in its own block of counters, which only that
+     * thread writes, so counting takes no lock and no atomic
+     * read-modify-write. metrics::dump_prometheus() adds up the blocks of
+     * all the threads; the counts of threads which have exited are kept.
+     *
+     * Memory allocations and Workspace hits and misses are always counted.
+     * The wall time of operations, the same ones as the slow operation log,
+     * is only measured after metrics::set_timing(true).
+     * @{
+     */
+
+    namespace detail
+    {
+        /// Counters of one thread, written by that thread only
+        struct MetricsBlock
+        {
+            enum Counter
+            {
+                allocations,            ///< Blocks of memory allocated
+                allocated_bytes,        ///< Bytes of those blocks
+                live_bytes,             ///< Bytes allocated minus bytes freed, may be negative in one block
+                workspace_hits,         ///< Workspace buffers taken from memory it held
+                workspace_misses,       ///< Workspace buffers which needed a new block
+                counters
+            };
+
+            static constexpr std::size_t max_operations = 32;
+            static constexpr std::size_t max_tags = 64;
+            static constexpr std::size_t buckets = 9;   ///< Buckets of the timing histogram, the last one is +Inf
+
+            /// Upper bound of bucket `b` but the last, in seconds
+            static double bound(std::size_t b)
+            {
+                static const double bounds[buckets - 1] = {1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1, 10};
+                return bounds[b];
+            }
+
+            /// Timings of one operation
+            struct Operation
+            {
+                std::atomic<const char*> name;
+                std::atomic<std::uint64_t> nanoseconds;
+                std::atomic<std::uint64_t> counts[buckets];
+            };
+
+            /// Memory of one MemoryTag
+            struct Tag
+            {
+                std::atomic<const char*> name;
+                std::atomic<std::int64_t> live_bytes;
+            };
+
+            std::atomic<std::int64_t> values[counters];
+            Operation operations[max_operations];
+            Tag tags[max_tags];
+
+            MetricsBlock()
+            {
+                for (std::size_t c = 0; c < counters; ++c) values[c].store(0, std::memory_order_relaxed);
+                for (std::size_t i = 0; i < max_operations; ++i)
+                {
+                    operations[i].nanoseconds.store(0, std::memory_order_relaxed);
+                    for (std::size_t b = 0; b < buckets; ++b) operations[i].counts[b].store(0, std::memory_order_relaxed);
+                    operations[i].name.store(nullptr, std::memory_order_release);
+                }
+                for (std::size_t i = 0; i < max_tags; ++i)
+                {
+                    tags[i].live_bytes.store(0, std::memory_order_relaxed);
+                    tags[i].name.store(nullptr, std::memory_order_release);
+                }
+            }
+
+            MetricsBlock(const MetricsBlock&) = delete;
+            MetricsBlock& operator=(const MetricsBlock&) = delete;
+
+            /// Add to a counter of this block, only its writer may call it
+            template<typename T>
+            static void add(std::atomic<T>& value, T n)
+            {
+                value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+            }
+
+            void count(Counter counter, std::int64_t n)
+            {
+                add(values[counter], n);
+            }
+
+            /// Entry of `slots` named `name`, the first unused one if none is, `nullptr` if all are used
+            template<typename Slot, std::size_t n>
+            static Slot* find(Slot (&slots)[n], const char* name)
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    const char* slot = slots[i].name.load(std::memory_order_relaxed);
+                    if (!slot)
+                    {
+                        slots[i].name.store(name, std::memory_order_release);
+                        return &slots[i];
+                    }
+                    if (slot == name || std::strcmp(slot, name) == 0) return &slots[i];
+                }
+                return nullptr;
+            }
+
+            /// Timings of the operation `name`
+            Operation* operation(const char* name)
+            {
+                return find(operations, name);
+            }
+
+            /// Add `bytes` to the live bytes of `tag`, which must outlive the program's threads
+            void charge(const char* tag, std::int64_t bytes)
+            {
+                if (Tag* slot = find(tags, tag)) add(slot->live_bytes, bytes);
+            }
+
+            /// Record one call of the operation `name`, which must outlive the program's threads
+            void time(const char* name, double seconds)
+            {
+                Operation* op = operation(name);
+                if (!op) return;
+
+                std::size_t b = 0;
+                while (b + 1 < buckets && seconds > bound(b)) ++b;
+
+                add(op->counts[b], std::uint64_t(1));
+                add(op->nanoseconds, static_cast<std::uint64_t>(seconds * 1e9));
+            }
+
+            /// Add the counts of `other`
+            void merge(const MetricsBlock& other)
+            {
+                for (std::size_t c = 0; c < counters; ++c) add(values[c], other.values[c].load(std::memory_order_relaxed));
+
+                for (std::size_t i = 0; i < max_operations; ++i)
+                {
+                    const char* name = other.operations[i].name.load(std::memory_order_acquire);
+                    if (!name) break;
+
+                    Operation* op = operation(name);
+                    if (!op) break;
+
+                    add(op->nanoseconds, other.operations[i].nanoseconds.load(std::memory_order_relaxed));
+                    for (std::size_t b = 0; b < buckets; ++b) add(op->counts[b], other.operations[i].counts[b].load(std::memory_order_relaxed));
+                }
+
+                for (std::size_t i = 0; i < max_tags; ++i)
+                {
+                    const char* name = other.tags[i].name.load(std::memory_order_acquire);
+                    if (!name) break;
+                    charge(name, other.tags[i].live_bytes.load(std::memory_order_relaxed));
+                }
+            }
+        };
+
+        /// The blocks of the running threads, and the counts of the exited ones
+        struct MetricsRegistry
+        {
+            std::mutex mutex;
+            std::vector<MetricsBlock*> blocks;
+            MetricsBlock retired;     ///< Written with `mutex` held
+
+            /// Never destroyed, threads may exit after static destructors ran
+            static MetricsRegistry& instance()
+            {
+                static MetricsRegistry* registry = new MetricsRegistry;
+                return *registry;
+            }
+        };
+
+        /// Block of the calling thread, `nullptr` while the thread exits
+        inline MetricsBlock* threadMetrics()
+        {
+            // Trivially destructible, so still valid while other thread_local objects are destroyed
+            static thread_local int state = 0;   // 0 before the block exists, 1 while it does, 2 once destroyed
+            if (state == 2) return nullptr;
+
+            struct Owner
+            {
+                MetricsBlock block;
+
+                Owner()
+                {
+                    MetricsRegistry& registry = MetricsRegistry::instance();
+                    std::lock_guard<std::mutex> lock(registry.mutex);
+                    registry.blocks.push_back(&block);
+                }
+
+                ~Owner()
+                {
+                    MetricsRegistry& registry = MetricsRegistry::instance();
+                    std::lock_guard<std::mutex> lock(registry.mutex);
+                    registry.retired.merge(block);
+                    registry.blocks.erase(std::find(registry.blocks.begin(), registry.blocks.end(), &block));
+                    state = 2;
+                }
+            };
+
+            static thread_local Owner owner;
+            state = 1;
+            return &owner.block;
+        }
+
+        /// Add `n` to `counter` of the calling thread
+        inline void count(MetricsBlock::Counter counter, std::int64_t n)
+        {
+            if (MetricsBlock* block = threadMetrics())
+            {
+                block->count(counter, n);
+                return;
+            }
+
+            MetricsRegistry& registry = MetricsRegistry::instance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.retired.count(counter, n);
+        }
+
+        /// Count the allocation (`bytes` > 0) or the release (`bytes` < 0) of a block of memory charged to `tag`
+        inline void countAllocation(const char* tag, std::int64_t bytes)
+        {
+            MetricsBlock* block = threadMetrics();
+
+            std::unique_lock<std::mutex> lock;
+            if (!block)
+            {
+                MetricsRegistry& registry = MetricsRegistry::instance();
+                lock = std::unique_lock<std::mutex>(registry.mutex);
+                block = &registry.retired;
+            }
+
+            if (bytes > 0)
+            {
+                block->count(MetricsBlock::allocations, 1);
+                block->count(MetricsBlock::allocated_bytes, bytes);
+            }
+            block->count(MetricsBlock::live_bytes, bytes);
+            block->charge(tag, bytes);
+        }
+
+        /// Set by metrics::set_timing() from any thread, read by every OpTimer
+        inline std::atomic<bool>& metricsTiming()
+        {
+            static std::atomic<bool> timing(false);
+            return timing;
+        }
+
+        /// Record the wall time of one call of the operation `name`
+        inline void countOperation(const char* name, double seconds)
+        {
+            if (MetricsBlock* block = threadMetrics()) block->time(name, seconds);
+        }
+
+        /// Add up the counters of all the threads into `total`
+        inline void collectMetrics(MetricsBlock& total)
+        {
+            MetricsRegistry& registry = MetricsRegistry::instance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            total.merge(registry.retired);
+            for (std::size_t i = 0; i < registry.blocks.size(); ++i) total.merge(*registry.blocks[i]);
+        }
+    }
+
+    namespace metrics
+    {
+        /// Whether the wall time of operations is measured
+        inline bool timing()
+        {
+            return detail::metricsTiming().load(std::memory_order_relaxed);
+        }
+
+        /// Measure the wall time of operations into the `pp_operation_seconds` histogram, off by default
+        inline void set_timing(bool on)
+        {
+            detail::metricsTiming().store(on, std::memory_order_relaxed);
+        }
 
         /**
-         * Slicing constructor
-         *
-         * @param str
-         *
-         * ### Example
-         * @include ndarray-slicing.cpp
+         * Write the counters of all the threads in the Prometheus text format.
          *
+         * @code
+         * std::ostringstream out;
+         * pp::metrics::dump_prometheus(out);
+         * respond(200, "text/plain; version=0.0.4", out.str());
+         * @endcode
          */
-        Range() : start(0), stop(0), step(1), has_stop(false) {}
-        
-        Range(const std::string &str) : Range(parseRange(str))
-        {}
+        inline void dump_prometheus(std::ostream& os)
+        {
+            using detail::MetricsBlock;
 
-        Range(int start, int stop, int step, bool has_stop=true) : start(start), stop(stop), step(step), has_stop(has_stop)
-        {}
+            MetricsBlock total;
+            detail::collectMetrics(total);
 
-        static Range parseRange(const std::string &str)
-        {
-            std::smatch sm;
-            int start, stop, step;
-            bool has_stop;
+            struct Metric
+            {
+                const char* name;
+                const char* type;
+                const char* help;
+                MetricsBlock::Counter counter;
+            };
+            static const Metric scalars[] = {
+                {"pp_allocations_total", "counter", "Blocks of memory allocated by the library.", MetricsBlock::allocations},
+                {"pp_allocated_bytes_total", "counter", "Bytes of memory allocated by the library.", MetricsBlock::allocated_bytes},
+                {"pp_live_bytes", "gauge", "Bytes of memory allocated by the library and not freed yet.", MetricsBlock::live_bytes},
+                {"pp_workspace_hits_total", "counter", "Workspace buffers taken from memory the workspace held.", MetricsBlock::workspace_hits},
+                {"pp_workspace_misses_total", "counter", "Workspace buffers which needed a new block of memory.", MetricsBlock::workspace_misses},
+            };
 
-            if(std::regex_match(str, sm, std::regex("^\\s*(-?\\d+)?\\s*:\\s*(-?\\d+)?\\s*:\\s*(-?\\d+)?\\s*$")))
+            for (const Metric& metric : scalars)
             {
-                // for slice format like "1:2:3"
-                start = (sm[1] == "")? 0: std::stoi( sm[1] );
-                stop   = (sm[2] == "")? 0: std::stoi( sm[2] );
-                step  = (sm[3] == "")? 1: std::stoi( sm[3] );
+                os << "# HELP " << metric.name << ' ' << metric.help << '\n'
+                   << "# TYPE " << metric.name << ' ' << metric.type << '\n'
+                   << metric.name << ' ' << total.values[metric.counter].load(std::memory_order_relaxed) << '\n';
+            }
 
-                has_stop = (sm[2] != "");
+            os << "# HELP pp_live_bytes_by_tag Bytes of memory allocated by the library and not freed yet, by MemoryTag.\n"
+               << "# TYPE pp_live_bytes_by_tag gauge\n";
+
+            for (std::size_t i = 0; i < MetricsBlock::max_tags; ++i)
+            {
+                const char* name = total.tags[i].name.load(std::memory_order_relaxed);
+                if (!name) break;
+                os << "pp_live_bytes_by_tag{tag=\"" << name << "\"} " << total.tags[i].live_bytes.load(std::memory_order_relaxed) << '\n';
             }
-            else if(std::regex_match(str, sm, std::regex("^\\s*(-?\\d+)?\\s*:\\s*(-?\\d+)?\\s*$")))
+
+            os << "# HELP pp_operation_seconds Wall time of the operations, when metrics::set_timing() is on.\n"
+               << "# TYPE pp_operation_seconds histogram\n";
+
+            for (std::size_t i = 0; i < MetricsBlock::max_operations; ++i)
             {
-                // for slice format like "1:2"
-                start = (sm[1] == "")? 0: std::stoi( sm[1] );
-                stop   = (sm[2] == "")? 0: std::stoi( sm[2] );
-                step  = 1;
+                const MetricsBlock::Operation& op = total.operations[i];
+                const char* name = op.name.load(std::memory_order_relaxed);
+                if (!name) break;
 
-                has_stop = (sm[2] != "");
+                std::uint64_t cumulative = 0;
+                for (std::size_t b = 0; b < MetricsBlock::buckets; ++b)
+                {
+                    cumulative += op.counts[b].load(std::memory_order_relaxed);
+                    os << "pp_operation_seconds_bucket{op=\"" << name << "\",le=\"";
+                    if (b + 1 < MetricsBlock::buckets) os << MetricsBlock::bound(b);
+                    else os << "+Inf";
+                    os << "\"} " << cumulative << '\n';
+                }
+                os << "pp_operation_seconds_sum{op=\"" << name << "\"} " << op.nanoseconds.load(std::memory_order_relaxed) * 1e-9 << '\n'
+                   << "pp_operation_seconds_count{op=\"" << name << "\"} " << cumulative << '\n';
             }
-            else
+        }
+    }
+
+    /** @} */
+
+
+    /**
+     * @addtogroup memory Memory tags
+     * Attribution of the memory of arrays to the parts of a program.
+     *
+     * Memory allocated by the library while a MemoryTag is in scope is
+     * charged to its tag, and memory allocated outside of any to
+     * "untagged". metrics::live_bytes_by_tag() and metrics::dump_prometheus()
+     * report the bytes still allocated for each tag.
+     *
+     * Workspace memory is always charged. The elements of arrays are charged
+     * when PP_NDARRAY_TAGGED_MEMORY is defined, which makes TaggedAllocator
+     * the allocator of every Inner. An array then keeps its tag: outside of a
+     * MemoryTag, copies, slices and the results of take(), sum() along an
+     * axis and matmul() are charged to the tag of their source.
+     * @{
+     */
+
+    namespace detail
+    {
+        /// Tag of the innermost MemoryTag of the thread, `nullptr` without one
+        inline const char*& memoryTag()
+        {
+            static thread_local const char* tag = nullptr;
+            return tag;
+        }
+
+        /// Use `tag`, the tag of a source array, for allocations unless a MemoryTag is in scope
+        class InheritTag
+        {
+        public:
+            explicit InheritTag(const char* tag) : previous_(memoryTag())
             {
-                // not support slice format like "1"
-                throw std::invalid_argument("Invalid slice format");
+                if (!previous_) memoryTag() = tag;
+            }
+
+            InheritTag(const InheritTag&) = delete;
+            InheritTag& operator=(const InheritTag&) = delete;
+
+            ~InheritTag()
+            {
+                memoryTag() = previous_;
             }
 
-            return {start, stop, step, has_stop};
-        }
-    };
+        private:
+            const char* previous_;
+        };
+    }
+
+    /**
+     * Charges the memory allocated by the calling thread to `tag` while in scope.
+     *
+     * `tag` is not copied and must outlive the memory allocated under it,
+     * a string literal in practice. Nested tags replace the outer one until
+     * they go out of scope.
+     *
+     * @code
+     * pp::MemoryTag tag("feature-cache");
+     * pp::Ndarray<float[2]> features(rows, cols);        // charged to "feature-cache"
+     * @endcode
+     */
+    class MemoryTag
+    {
+    public:
+        explicit MemoryTag(const char* tag) : previous_(detail::memoryTag())
+        {
+            detail::memoryTag() = tag;
+        }
+
+        MemoryTag(const MemoryTag&) = delete;
+        MemoryTag& operator=(const MemoryTag&) = delete;
+
+        ~MemoryTag()
+        {
+            detail::memoryTag() = previous_;
+        }
+
+    private:
+        const char* previous_;
+    };
+
+    /**
+     * std::allocator which charges its memory to a tag.
+     *
+     * The tag is the one of the MemoryTag in scope when the allocator is
+     * constructed. Copies of a container keep its tag, unless a MemoryTag is
+     * in scope, and so does moving or swapping it. Copy assignment keeps the
+     * tag of the destination; for an Inner this holds for its rows too, the
+     * rows it gains are charged to its tag unless a MemoryTag is in scope.
+     */
+    template<typename T>
+    class TaggedAllocator
+    {
+    public:
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::false_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        TaggedAllocator() : tag_(detail::memoryTag() ? detail::memoryTag() : "untagged") {}
+        explicit TaggedAllocator(const char* tag) : tag_(tag) {}
+
+        template<typename U>
+        TaggedAllocator(const TaggedAllocator<U>& other) : tag_(other.tag()) {}
+
+        template<typename U> struct rebind { using other = TaggedAllocator<U>; };
+
+        const char* tag() const { return tag_; }    ///< Tag the memory is charged to
+
+        T* allocate(std::size_t n)
+        {
+            T* p = std::allocator<T>().allocate(n);
+            detail::countAllocation(tag_, static_cast<std::int64_t>(n * sizeof(T)));
+            return p;
+        }
+
+        void deallocate(T* p, std::size_t n)
+        {
+            detail::countAllocation(tag_, -static_cast<std::int64_t>(n * sizeof(T)));
+            std::allocator<T>().deallocate(p, n);
+        }
+
+        TaggedAllocator select_on_container_copy_construction() const
+        {
+            return TaggedAllocator(detail::memoryTag() ? detail::memoryTag() : tag_);
+        }
+
+        template<typename U>
+        bool operator==(const TaggedAllocator<U>& other) const
+        {
+            return tag_ == other.tag() || std::strcmp(tag_, other.tag()) == 0;
+        }
+
+        template<typename U>
+        bool operator!=(const TaggedAllocator<U>& other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        const char* tag_;
+    };
+
+    namespace detail
+    {
+#if defined(PP_NDARRAY_TAGGED_MEMORY)
+        template<typename T> using default_allocator = TaggedAllocator<T>;
+#else
+        template<typename T> using default_allocator = std::allocator<T>;
+#endif
+
+        template<typename A>
+        const char* allocatorTag(const A&) { return nullptr; }
+
+        template<typename T>
+        const char* allocatorTag(const TaggedAllocator<T>& allocator) { return allocator.tag(); }
+
+        /// Tag of the memory of `arr`, `nullptr` if it is not charged to one
+        template<typename A>
+        auto tagOf(const A& arr, int) -> decltype(allocatorTag(arr.get_allocator()))
+        {
+            return allocatorTag(arr.get_allocator());
+        }
+
+        template<typename A>
+        const char* tagOf(const A&, long) { return nullptr; }
+    }
+
+    /// Tag the elements of `arr` are charged to, `nullptr` without PP_NDARRAY_TAGGED_MEMORY
+    template<typename A>
+    const char* memory_tag(const A& arr)
+    {
+        return detail::tagOf(arr, 0);
+    }
+
+    namespace metrics
+    {
+        /// Bytes allocated by the library and not freed yet for each MemoryTag, largest first
+        inline std::vector<std::pair<std::string, std::int64_t>> live_bytes_by_tag()
+        {
+            detail::MetricsBlock total;
+            detail::collectMetrics(total);
+
+            std::vector<std::pair<std::string, std::int64_t>> result;
+            for (std::size_t i = 0; i < detail::MetricsBlock::max_tags; ++i)
+            {
+                const char* name = total.tags[i].name.load(std::memory_order_relaxed);
+                if (!name) break;
+                result.push_back(std::make_pair(std::string(name), total.tags[i].live_bytes.load(std::memory_order_relaxed)));
+            }
+
+            std::sort(result.begin(), result.end(), [](const std::pair<std::string, std::int64_t>& a, const std::pair<std::string, std::int64_t>& b) {
+                return a.second > b.second;
+            });
+            return result;
+        }
+    }
+
+    /** @} */
+
+
+    /**
+     * @addtogroup profiling Slow operation log
+     * Reports operations which take longer than a threshold.
+     *
+     * The log is off by default, when on, each public operation which
+     * materializes or reduces an array (slicing, View::copy(), eval(),
+     * fill(), copyto(), take(), sum(), matmul(), nonzero(), argwhere())
+     * measures its wall time and passes a SlowOp to the handler set with
+     * set_slow_op_handler() if it took longer than slow_op_threshold()
+     * seconds. The default handler writes one line per operation to the
+     * file set with set_slow_op_log(), stderr by default.
+     *
+     * Only the outermost operation is reported, e.g. a slice and not the
+     * View::copy() it is made of. While the log and metrics::timing() are
+     * off, an operation only compares the threshold with infinity.
+     *
+     * The threshold and handler are global and meant to be set once, before
+     * other threads use the library; SlowOpTag labels the operations of the
+     * calling thread.
+     * @{
+     */
+
+#ifndef PP_NDARRAY_SLOW_OP_THRESHOLD
+#define PP_NDARRAY_SLOW_OP_THRESHOLD std::numeric_limits<double>::infinity()
+#endif
+
+    /// An operation which took longer than slow_op_threshold()
+    struct SlowOp
+    {
+        /// An array the operation read or wrote
+        struct Operand
+        {
+            std::vector<std::size_t> shape;         ///< Length of each axis
+            std::vector<std::ptrdiff_t> strides;    ///< Elements between neighbours along each axis, in the underlying array
+        };
+
+        const char* name;               ///< Name of the operation, e.g. "slice" or "matmul"
+        std::string dtype;              ///< Type of the elements, e.g. "float32"
+        std::vector<Operand> operands;  ///< Arrays of the operation, the output last when it has one
+        std::size_t threads;            ///< Threads the operation ran on, the calling one only for now
+        const char* tag;                ///< Tag of the innermost SlowOpTag of the thread, "" without one
+        double seconds;                 ///< Wall time
+    };
+
+    /// Called with each slow operation
+    using slow_op_handler = void (*)(const SlowOp&);
+
+    template<typename Source, std::size_t dim> struct View;
+
+    namespace detail
+    {
+        inline double& slowOpThreshold()
+        {
+            static double threshold = PP_NDARRAY_SLOW_OP_THRESHOLD;
+            return threshold;
+        }
+
+        inline std::FILE*& slowOpLog()
+        {
+            static std::FILE* file = stderr;
+            return file;
+        }
+
+        /// Write `op` as one line to the file set with set_slow_op_log()
+        inline void printSlowOp(const SlowOp& op)
+        {
+            std::ostringstream line;
+            line << "pp::Ndarray slow " << op.name << ": " << op.seconds << " s, " << op.dtype;
+
+            for (const SlowOp::Operand& operand : op.operands)
+            {
+                line << " (";
+                for (std::size_t k = 0; k < operand.shape.size(); ++k) line << (k ? ", " : "") << operand.shape[k];
+                line << ") strides (";
+                for (std::size_t k = 0; k < operand.strides.size(); ++k) line << (k ? ", " : "") << operand.strides[k];
+                line << ")";
+            }
+
+            line << ", " << op.threads << " thread" << (op.threads == 1 ? "" : "s");
+            if (*op.tag) line << ", tag " << op.tag;
+            line << "\n";
+
+            std::fputs(line.str().c_str(), slowOpLog());
+            std::fflush(slowOpLog());
+        }
+
+        inline slow_op_handler& slowOpHandler()
+        {
+            static slow_op_handler handler = printSlowOp;
+            return handler;
+        }
+
+        inline const char*& slowOpTag()
+        {
+            static thread_local const char* tag = "";
+            return tag;
+        }
+
+        /// Operations of the thread being timed, only the outermost one reports
+        inline std::size_t& slowOpDepth()
+        {
+            static thread_local std::size_t depth = 0;
+            return depth;
+        }
+
+        /// Name of `T` after its NumPy dtype, "object" for class types
+        template<typename T>
+        std::string dtypeName()
+        {
+            if (std::is_same<T, bool>::value) return "bool";
+            if (std::is_integral<T>::value) return (std::is_signed<T>::value ? "int" : "uint") + std::to_string(8 * sizeof(T));
+            if (std::is_floating_point<T>::value) return "float" + std::to_string(8 * sizeof(T));
+            return "object";
+        }
+
+        /// A contiguous operand of shape `shape`
+        template<std::size_t dim>
+        SlowOp::Operand describe(const std::array<std::size_t, dim>& shape)
+        {
+            SlowOp::Operand operand;
+            operand.shape.assign(shape.begin(), shape.end());
+            operand.strides.resize(dim);
+
+            std::ptrdiff_t stride = 1;
+            for (std::size_t k = dim; k-- > 0;)
+            {
+                operand.strides[k] = stride;
+                stride *= static_cast<std::ptrdiff_t>(shape[k]);
+            }
+
+            return operand;
+        }
+
+        /// A view, with its strides counted in elements of its source
+        template<typename Source, std::size_t dim>
+        SlowOp::Operand describe(const View<Source, dim>& view)
+        {
+            const SlowOp::Operand source = describe(view.source().shape());
+            const std::array<std::size_t, dim> shape = view.shape();
+
+            SlowOp::Operand operand;
+            operand.shape.assign(shape.begin(), shape.end());
+            operand.strides.assign(dim, 0);
+
+            for (std::size_t k = 0; k < dim; ++k)
+                for (std::size_t j = 0; j < source.strides.size(); ++j)
+                    operand.strides[k] += view.strides()[k][j] * source.strides[j];
+
+            return operand;
+        }
+
+        /// An array or expression, assumed contiguous
+        template<typename A>
+        auto describe(const A& a) -> decltype(describe(a.shape()))
+        {
+            return describe(a.shape());
+        }
+
+        /**
+         * Times a public operation while the log or metrics::timing() is on.
+         *
+         * Construct it on entry and call done() with the operands before
+         * returning; nothing is reported if the operation raises an error.
+         */
+        class OpTimer
+        {
+        public:
+            OpTimer() : timed_((slowOpThreshold() < std::numeric_limits<double>::infinity() || metricsTiming().load(std::memory_order_relaxed)) && slowOpDepth() == 0)
+            {
+                if (timed_)
+                {
+                    slowOpDepth() = 1;
+                    start_ = std::chrono::steady_clock::now();
+                }
+            }
+
+            OpTimer(const OpTimer&) = delete;
+            OpTimer& operator=(const OpTimer&) = delete;
+
+            ~OpTimer()
+            {
+                if (timed_) slowOpDepth() = 0;
+            }
+
+            /// Report the operation if it was slow, `operands` are the arrays, views or expressions it used
+            template<typename T, typename... Operands>
+            void done(const char* name, const Operands&... operands) const
+            {
+                if (!timed_) return;
+
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+                if (metricsTiming().load(std::memory_order_relaxed)) countOperation(name, seconds);
+                if (!(seconds > slowOpThreshold())) return;
+
+                SlowOp op;
+                op.name = name;
+                op.dtype = dtypeName<T>();
+                op.operands = {describe(operands)...};
+                op.threads = 1;
+                op.tag = slowOpTag();
+                op.seconds = seconds;
+                slowOpHandler()(op);
+            }
+
+        private:
+            bool timed_;
+            std::chrono::steady_clock::time_point start_;
+        };
+    }
+
+    /// Seconds from which an operation is reported, infinity (the default) turns the log off
+    inline double slow_op_threshold()
+    {
+        return detail::slowOpThreshold();
+    }
+
+    /// Report operations taking longer than `seconds`, infinity turns the log off
+    inline void set_slow_op_threshold(double seconds)
+    {
+        detail::slowOpThreshold() = seconds;
+    }
+
+    /// Set the handler called with slow operations, returns the previous one; `nullptr` restores the default
+    inline slow_op_handler set_slow_op_handler(slow_op_handler handler)
+    {
+        const slow_op_handler previous = detail::slowOpHandler();
+        detail::slowOpHandler() = handler ? handler : detail::printSlowOp;
+        return previous;
+    }
+
+    /// Set the file the default handler writes to, which stays open; stderr by default
+    inline void set_slow_op_log(std::FILE* file)
+    {
+        detail::slowOpLog() = file ? file : stderr;
+    }
+
+    /**
+     * Tags the slow operations of the calling thread while in scope.
+     *
+     * `tag` is not copied and must outlive the SlowOpTag; nested tags
+     * replace the outer one until they go out of scope.
+     *
+     * @code
+     * pp::SlowOpTag tag("ingest");
+     * auto batch = frames.slice(pp::range(0, n));     // reported with tag "ingest"
+     * @endcode
+     */
+    class SlowOpTag
+    {
+    public:
+        explicit SlowOpTag(const char* tag) : previous_(detail::slowOpTag())
+        {
+            detail::slowOpTag() = tag;
+        }
+
+        SlowOpTag(const SlowOpTag&) = delete;
+        SlowOpTag& operator=(const SlowOpTag&) = delete;
+
+        ~SlowOpTag()
+        {
+            detail::slowOpTag() = previous_;
+        }
+
+    private:
+        const char* previous_;
+    };
+
+    /** @} */
+
+
+    /// Class for slicing index
+    struct Range
+    {
+        int start;
+        int stop;
+        int step;
+        bool has_stop;  ///< Flag to check if stop is given
+        bool has_start; ///< Flag to check if start is given
+
+        /// Concrete bounds of a Range once applied to an axis of known size
+        struct Bounds
+        {
+            std::ptrdiff_t start;   ///< First selected index
+            std::size_t length;     ///< Number of selected indices
+            std::ptrdiff_t step;    ///< Distance between selected indices
+        };
+
+        /**
+         * Slicing constructor
+         *
+         * @param str
+         *
+         * ### Example
+         * @include ndarray-slicing.cpp
+         *
+         */
+        Range() : start(0), stop(0), step(1), has_stop(false), has_start(false) {}
+        
+        Range(const std::string &str) : Range(parseRange(str))
+        {}
+
+        Range(int start, int stop, int step, bool has_stop=true) : start(start), stop(stop), step(step), has_stop(has_stop), has_start(true)
+        {}
+
+        static Range parseRange(const std::string &str)
+        {
+            Expected<Range> range = try_parse(str);
+            if (!range && range.error() == Error::out_of_range) detail::raise<std::out_of_range>("Slice bound out of range");
+            if (!range) detail::raise<std::invalid_argument>("Invalid slice format");
+            return *range;
+        }
+
+        /// Same as parseRange(), with the error in the result instead of raised, Error::out_of_range if a bound does not fit an int
+        static Expected<Range> try_parse(const std::string &str)
+        {
+            std::smatch sm;
+            int start, stop, step;
+            bool has_stop, has_start;
+            Error error = Error::none;
+
+            if(std::regex_match(str, sm, std::regex("^\\s*(-?\\d+)?\\s*:\\s*(-?\\d+)?\\s*:\\s*(-?\\d+)?\\s*$")))
+            {
+                // for slice format like "1:2:3"
+                start = parseBound(sm[1], 0, error);
+                stop  = parseBound(sm[2], 0, error);
+                step  = parseBound(sm[3], 1, error);
+
+                has_stop = (sm[2] != "");
+                has_start = (sm[1] != "");
+            }
+            else if(std::regex_match(str, sm, std::regex("^\\s*(-?\\d+)?\\s*:\\s*(-?\\d+)?\\s*$")))
+            {
+                // for slice format like "1:2"
+                start = parseBound(sm[1], 0, error);
+                stop  = parseBound(sm[2], 0, error);
+                step  = 1;
+
+                has_stop = (sm[2] != "");
+                has_start = (sm[1] != "");
+            }
+            else
+            {
+                // not support slice format like "1"
+                return Error::invalid_argument;
+            }
+
+            if (error != Error::none) return error;
+
+            Range range(start, stop, step, has_stop);
+            range.has_start = has_start;
+            return range;
+        }
+
+        /**
+         * Apply the Range to an axis of `size` elements.
+         *
+         * Follows Python's `slice.indices()`: negative start / stop count from
+         * the end, out of range bounds are clamped, and a missing start / stop
+         * depends on the sign of step.
+         */
+        Bounds resolve(std::size_t size) const
+        {
+            if (step == 0) detail::raise<std::invalid_argument>("Slice step cannot be zero");
+
+            const std::ptrdiff_t n = static_cast<std::ptrdiff_t>(size);
+            const std::ptrdiff_t lower = (step > 0)? 0: -1;
+            const std::ptrdiff_t upper = (step > 0)? n: n - 1;
+
+            std::ptrdiff_t first = has_start? clamp(start, n, lower, upper): (step > 0? lower: upper);
+            std::ptrdiff_t last  = has_stop?  clamp(stop, n, lower, upper):  (step > 0? upper: lower);
+
+            std::size_t length = 0;
+            if (step > 0 && last > first) length = (last - first + step - 1) / step;
+            if (step < 0 && first > last) length = (first - last - step - 1) / -step;
+
+            return {first, length, step};
+        }
+
+    private:
+        /// The integer matched by `digits`, or `fallback` if nothing matched; sets `error` if it does not fit an int
+        static int parseBound(const std::ssub_match& digits, int fallback, Error& error)
+        {
+            if (!digits.matched || digits.length() == 0) return fallback;
+
+            const std::string text = digits.str();
+            errno = 0;
+            const long long value = std::strtoll(text.c_str(), nullptr, 10);
+            if (errno == ERANGE || value < std::numeric_limits<int>::min() || value > std::numeric_limits<int>::max())
+            {
+                error = Error::out_of_range;
+                return fallback;
+            }
+            return static_cast<int>(value);
+        }
+
+        static std::ptrdiff_t clamp(std::ptrdiff_t idx, std::ptrdiff_t n, std::ptrdiff_t lower, std::ptrdiff_t upper)
+        {
+            if (idx < 0) idx += n;
+            return idx < lower? lower: (idx > upper? upper: idx);
+        }
+    };
+
+    /**
+     * \addtogroup slicing_args Slicing arguments
+     * Arguments accepted by the variadic slicing API.
+     *
+     * Each argument is dispatched at compile time, so slicing this way never
+     * goes through `std::string` or `std::regex`:
+     *   - an integer picks one index and removes the axis,
+     *   - a Range (e.g. pp::range()) selects a sub-range and keeps the axis,
+     *   - pp::all keeps the whole axis,
+     *   - pp::newaxis inserts an axis of length 1,
+     *   - pp::ellipsis keeps all the axes which are not given, at most once.
+     *
+     * Axes which are not given are kept whole.
+     * @{
+     */
+
+    /// Tag type to select a whole axis, like `:` in Python
+    struct All {};
+
+    /// Tag type to insert an axis of length 1, like `None` in Python
+    struct NewAxis {};
+
+    /// Tag type to keep the remaining axes, like `...` in Python
+    struct Ellipsis {};
+
+    /// Select a whole axis
+    static const All all{};
+
+    /// Insert an axis of length 1
+    static const NewAxis newaxis{};
+
+    /// Keep the remaining axes
+    static const Ellipsis ellipsis{};
+
+    /// Create a Range from start (inclusive) to stop (exclusive)
+    inline Range range(int start, int stop, int step = 1)
+    {
+        return Range(start, stop, step);
+    }
+
+    /// Check if the type selects an axis of the array (integers, Range and All)
+    template<typename T>
+    struct is_axis_arg : std::integral_constant<bool,
+        std::is_integral<T>::value || std::is_same<T, Range>::value || std::is_same<T, All>::value> {};
+
+    /// Check if the type can be used as a variadic slicing argument
+    template<typename T>
+    struct is_slice_arg : std::integral_constant<bool,
+        is_axis_arg<T>::value || std::is_same<T, NewAxis>::value || std::is_same<T, Ellipsis>::value> {};
+
+    template<typename T> struct is_newaxis : std::is_same<T, NewAxis> {};    ///< Check if the type is NewAxis
+    template<typename T> struct is_ellipsis : std::is_same<T, Ellipsis> {};  ///< Check if the type is Ellipsis
+
+    /// Count the types in `Args` which satisfy `Pred`
+    template<template<typename> class Pred, typename... Args>
+    struct count_if : std::integral_constant<std::size_t, 0> {};
+    template<template<typename> class Pred, typename T, typename... Rest>
+    struct count_if<Pred, T, Rest...>
+    : std::integral_constant<std::size_t, Pred<T>::value + count_if<Pred, Rest...>::value> {};  /**< @copydoc count_if */
+
+    /// Dimension of the result of slicing a `dim` dimensional array with `Args`
+    template<std::size_t dim, typename... Args>
+    struct slice_rank : std::integral_constant<std::size_t,
+        dim + count_if<is_newaxis, Args...>::value - count_if<std::is_integral, Args...>::value> {};
+
+    /// A slicing argument once its type has been dispatched
+    struct SliceArg
+    {
+        enum Kind { index, range, newaxis, ellipsis };
+
+        Kind kind;
+        int idx;        ///< Used when kind is index
+        Range slice;    ///< Used when kind is range
+
+        template<typename Index, typename std::enable_if<std::is_integral<Index>::value, int>::type = 0>
+        SliceArg(Index idx) : kind(index), idx(static_cast<int>(idx)) {}
+        SliceArg(const Range& r) : kind(range), idx(0), slice(r) {}
+        SliceArg(const All&) : kind(range), idx(0) {}
+        SliceArg(const NewAxis&) : kind(newaxis), idx(0) {}
+        SliceArg(const Ellipsis&) : kind(ellipsis), idx(0) {}
+    };
+
+    /**
+     * Parse a comma separated slicing string, e.g. `"0:1, ..., None"`.
+     *
+     * Besides the formats of Range, `...` keeps the remaining axes and
+     * `None` or `newaxis` inserts an axis of length 1.
+     */
+    inline std::vector<SliceArg> parseSlices(const std::string& str)
+    {
+        std::vector<SliceArg> slices;
+
+        std::regex re("\\s*,\\s*");
+        std::sregex_token_iterator first{str.begin(), str.end(), re, -1}, last;
+        for (; first != last; ++first) {
+            const std::string token = std::regex_replace(first->str(), std::regex("^\\s+|\\s+$"), "");
+            if (token == "...")                             slices.push_back(Ellipsis());
+            else if (token == "None" || token == "newaxis") slices.push_back(NewAxis());
+            else                                            slices.push_back(Range::parseRange(token));
+        }
+
+        return slices;
+    }
+
+    /** @} */
+
+
+    /// Class with common methods
+    template< typename Dtype, typename Allocator = detail::default_allocator<Dtype> >
+    struct BaseVector : public std::vector<Dtype, Allocator>
+    {
+        using std::vector<Dtype, Allocator>::vector;
+
+        // toString for types that are arithmetic or std::string
+        template <typename U = Dtype>
+        auto toString(int /* indentLevel */ = 0) const -> 
+        typename std::enable_if<std::integral_constant<bool, std::is_arithmetic<U>::value || std::is_same<U, std::string>::value>::value, std::string>::type
+        {
+            if (this->empty()) return "[ ]";
+            std::stringstream ss;
+            for (size_t i = 0; i < this->size(); ++i) {
+                ss << (i==0? "[ ": "")
+                   << this->at(i)
+                   << (i != this->size()-1 ? ", " : " ]");
+            }
+            return ss.str();
+        }
+
+        // toString for types that have toString() method
+        template <typename U = Dtype>
+        auto toString(int indentLevel = 0) const ->
+        decltype(std::declval<U>().toString())
+        {
+            if (this->empty()) return "[ ]";
+            std::stringstream ss;
+            std::string indent(indentLevel * 2, ' ');
+            for (size_t i = 0; i < this->size(); ++i) {
+                // Recursive call for nested vectors
+                ss << (i==0? "[\n": "")
+                   << indent
+                   << "  " << (*this)[i].toString(indentLevel + 1)
+                   << (i != this->size()-1 ? "," : "")
+                   << "\n";
+            }
+            ss << indent << "]";
+            return ss.str();
+        }
+
+        using reference = typename std::vector<Dtype, Allocator>::reference;
+        using const_reference = typename std::vector<Dtype, Allocator>::const_reference;
+
+        reference at(int idx)
+        {
+            if (!wrap(idx)) detail::raise<std::out_of_range>("Index out of range");
+            return this->begin()[idx];
+        }
+
+        const_reference at(int idx) const
+        {
+            if (!wrap(idx)) detail::raise<std::out_of_range>("Index out of range");
+            return this->begin()[idx];
+        }
+
+        /// Same as at(), with the error in the result instead of raised
+        Expected<reference> try_at(int idx)
+        {
+            if (!wrap(idx)) return Error::out_of_range;
+            return Expected<reference>(this->begin()[idx]);
+        }
+
+        Expected<const_reference> try_at(int idx) const
+        {
+            if (!wrap(idx)) return Error::out_of_range;
+            return Expected<const_reference>(this->begin()[idx]);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const BaseVector<Dtype, Allocator>& vec)
+        {
+            return os << vec.toString();
+        }
+
+    private:
+        /// Make a negative index count from the end, returns whether it is in range
+        bool wrap(int& idx) const
+        {
+            if (idx < 0) idx += static_cast<int>(this->size());
+            return idx >= 0 && static_cast<std::size_t>(idx) < this->size();
+        }
+
+
+    };
+
+    /**
+     * @addtogroup inner Inner
+     * Implementation of Ndarray.
+     * @{
+     */
+    
+    template<typename Source, std::size_t dim> struct View;
+
+    /// Class for multi-dimensional array
+    // primary template
+    template<typename Dtype, std::size_t dim>
+    struct Inner : public BaseVector<Inner<Dtype, dim - 1>>
+    {
+        static_assert(dim >= 1, "Dimension must be greater than zero!");
+
+        using dtype = Dtype;                        ///< Type of the elements
+        static constexpr std::size_t ndim = dim;    ///< Number of dimensions
+
+        // Construct in Recursive
+        template<typename... Args>
+        Inner(std::size_t n = 0, Args... args) : BaseVector<Inner<Dtype, dim - 1>>(n, Inner<Dtype, dim - 1>(args...))
+        {}
+
+        /// Constructor to handle initializer list for nested lists
+        Inner(std::initializer_list<Inner<Dtype, dim - 1>> initList) : BaseVector<Inner<Dtype, dim - 1>>(initList)
+        {}
+
+        Inner(const Inner&) = default;
+        Inner(Inner&&) = default;
+        Inner& operator=(Inner&&) = default;
+
+        /// Copy the elements of `other`; rows added to this array are charged to its tag, like the rows it has
+        Inner& operator=(const Inner& other)
+        {
+            detail::InheritTag tag(detail::tagOf(*this, 0));
+            BaseVector<Inner<Dtype, dim - 1>>::operator=(other);
+            return *this;
+        }
+
+        /// Copy from lower dimension
+        template<typename T, std::size_t M, typename = typename std::enable_if<(M < dim)>::type>
+        Inner(const Inner<T, M>& lowerDimInner)
+        {
+            this->push_back(Inner<T, dim - 1>(lowerDimInner));
+        }
+
+        /// Copy the elements of a view, e.g. View or RollView
+        template<typename Array, typename = typename std::enable_if<
+                     std::is_same<decltype(std::declval<const Array&>().copy()), Inner<Dtype, dim>>::value>::type>
+        Inner(const Array& view) : Inner(view.copy())
+        {}
+
+        /// Length of each axis, read from the first element of each level
+        std::array<std::size_t, dim> shape() const
+        {
+            std::array<std::size_t, dim> result = {};
+            result[0] = this->size();
+
+            if (!this->empty())
+            {
+                std::array<std::size_t, dim - 1> inner = this->front().shape();
+                std::copy(inner.begin(), inner.end(), result.begin() + 1);
+            }
+
+            return result;
+        }
+
+        /// Unchecked access to the element at the `dim` indices pointed by `idx`
+        typename BaseVector<Dtype>::reference element(const std::ptrdiff_t* idx)
+        {
+            return this->begin()[*idx].element(idx + 1);
+        }
+
+        typename BaseVector<Dtype>::const_reference element(const std::ptrdiff_t* idx) const
+        {
+            return this->begin()[*idx].element(idx + 1);
+        }
+
+        /// Unchecked access to the element at `idx`
+        typename BaseVector<Dtype>::const_reference get(const std::array<std::size_t, dim>& idx) const
+        {
+            std::array<std::ptrdiff_t, dim> pos;
+            std::copy(idx.begin(), idx.end(), pos.begin());
+            return element(pos.data());
+        }
+
+        /**
+         * @name Indexing
+         *
+         * Indexing for Ndarray
+         * Unlike Slicing, Indexing returns a reference to the element.
+         */
+        
+        template<typename... Indices,
+                 typename std::enable_if<(sizeof...(Indices) > 0), int>::type = 0,
+                 typename std::enable_if<conjunction<std::is_integral<Indices>...>::value, int>::type = 0>
+        auto operator()(int idx, Indices... indices) -> decltype(this->at(idx)(indices...)) 
+        {
+            return this->at(idx).operator()(indices...);
+        }
+
+        template<typename... Indices,
+                 typename std::enable_if<(sizeof...(Indices) > 0), int>::type = 0,
+                 typename std::enable_if<conjunction<std::is_integral<Indices>...>::value, int>::type = 0>
+        auto operator()(int idx, Indices... indices) const -> decltype(this->at(idx)(indices...))
+        {
+            return this->at(idx).operator()(indices...);
+        }
+
+        // For when there is only one index
+        Inner<Dtype, dim-1>& operator()(int idx)
+        {
+            return this->at(idx);
+        }
+
+        const Inner<Dtype, dim-1>& operator()(int idx) const
+        {
+            return this->at(idx);
+        }
+
+        using BaseVector<Inner<Dtype, dim - 1>>::try_at;
+
+        /// Same as operator()(idx, indices...), with the error in the result instead of raised
+        template<typename... Indices,
+                 typename std::enable_if<(sizeof...(Indices) > 0), int>::type = 0,
+                 typename std::enable_if<conjunction<std::is_integral<Indices>...>::value, int>::type = 0>
+        auto try_at(int idx, Indices... indices) -> decltype(this->at(idx).try_at(indices...))
+        {
+            Expected<Inner<Dtype, dim - 1>&> row = this->try_at(idx);
+            if (!row) return row.error();
+            return row->try_at(indices...);
+        }
+
+        template<typename... Indices,
+                 typename std::enable_if<(sizeof...(Indices) > 0), int>::type = 0,
+                 typename std::enable_if<conjunction<std::is_integral<Indices>...>::value, int>::type = 0>
+        auto try_at(int idx, Indices... indices) const -> decltype(this->at(idx).try_at(indices...))
+        {
+            Expected<const Inner<Dtype, dim - 1>&> row = this->try_at(idx);
+            if (!row) return row.error();
+            return row->try_at(indices...);
+        }
+
+        /// Slice when any argument is not an integer, see slice(const Args&...)
+        template<typename... Args,
+                 typename std::enable_if<conjunction<is_slice_arg<Args>...>::value, int>::type = 0,
+                 typename std::enable_if<!conjunction<std::is_integral<Args>...>::value, int>::type = 0>
+        Inner<Dtype, slice_rank<dim, Args...>::value> operator()(const Args&... args) const
+        {
+            return slice(args...);
+        }
+
+        /**
+         * @name Slicing
+         * 
+         * Slicing index for Ndarray
+         * Unlike Indexing, Slicing returns a new Ndarray.
+         */
+        
+        /// Slice with a string like `"0:1, ..., ::2"`, see parseSlices()
+        Inner<Dtype, dim> operator[](const std::string& input) const
+        {
+            detail::OpTimer timer;
+            const std::vector<SliceArg> slices = parseSlices(input);
+            const View<const Inner<Dtype, dim>, dim> v = View<const Inner<Dtype, dim>, dim>(*this).template apply<dim>(slices.data(), slices.size());
+            Inner<Dtype, dim> result = v.copy();
+            timer.done<Dtype>("slice", v);
+            return result;
+        }
+
+
+        template<std::size_t length>
+        Inner<Dtype, dim> slice(const std::array<Range, length> slices, int start, const int& end) const
+        {
+            if(start == end) return *this;
+
+            Inner<Dtype, dim> result;
+
+            Range::Bounds b = slices[start].resolve(this->size());
+            result.reserve(b.length);
+
+            for(std::size_t k = 0; k < b.length; ++k)
+            {
+                result.push_back(this->begin()[b.start + static_cast<std::ptrdiff_t>(k) * b.step].slice(slices, start + 1, end));
+            }
+
+            return result;
+        }
+
+        /**
+         * Slice with one argument per axis.
+         *
+         * Integers remove their axis, pp::newaxis adds one, see @ref slicing_args.
+         * Arguments are dispatched at compile time, no string is parsed.
+         *
+         * @code
+         * pp::Ndarray<int[3]> array(2, 3, 4);
+         * auto plane = array.slice(pp::all, 1);                   // Inner<int, 2>, shape 2x4
+         * auto part  = array(pp::range(0, 1), pp::all, 2);        // Inner<int, 2>, shape 1x3
+         * @endcode
+         */
+        template<typename... Args,
+                 typename std::enable_if<conjunction<is_slice_arg<Args>...>::value, int>::type = 0>
+        Inner<Dtype, slice_rank<dim, Args...>::value> slice(const Args&... args) const
+        {
+            detail::OpTimer timer;
+            const View<const Inner<Dtype, dim>, slice_rank<dim, Args...>::value> v = view(args...);
+            Inner<Dtype, slice_rank<dim, Args...>::value> result = v.copy();
+            timer.done<Dtype>("slice", v);
+            return result;
+        }
+
+        /**
+         * @name Views
+         *
+         * Same arguments as Slicing, but returns a View of the Ndarray.
+         * Nothing is copied, see @ref view.
+         */
+
+        template<typename... Args,
+                 typename std::enable_if<conjunction<is_slice_arg<Args>...>::value, int>::type = 0>
+        View<Inner<Dtype, dim>, slice_rank<dim, Args...>::value> view(const Args&... args)
+        {
+            return View<Inner<Dtype, dim>, dim>(*this).view(args...);
+        }
+
+        template<typename... Args,
+                 typename std::enable_if<conjunction<is_slice_arg<Args>...>::value, int>::type = 0>
+        View<const Inner<Dtype, dim>, slice_rank<dim, Args...>::value> view(const Args&... args) const
+        {
+            return View<const Inner<Dtype, dim>, dim>(*this).view(args...);
+        }
+
+        /// View with a string like `"..., None"`, `rank` is the dimension of the result
+        template<std::size_t rank>
+        View<Inner<Dtype, dim>, rank> view(const std::string& input)
+        {
+            const std::vector<SliceArg> slices = parseSlices(input);
+            return View<Inner<Dtype, dim>, dim>(*this).template apply<rank>(slices.data(), slices.size());
+        }
+
+        template<std::size_t rank>
+        View<const Inner<Dtype, dim>, rank> view(const std::string& input) const
+        {
+            const std::vector<SliceArg> slices = parseSlices(input);
+            return View<const Inner<Dtype, dim>, dim>(*this).template apply<rank>(slices.data(), slices.size());
+        }
+    };
+    
+    /// Class for 1-dimensional array
+    // partial specialization where dimension is 1
+    template<typename Dtype>
+    struct Inner<Dtype, 1> : public BaseVector<Dtype>
+    {
+        using dtype = Dtype;                        ///< Type of the elements
+        static constexpr std::size_t ndim = 1;      ///< Number of dimensions
+
+        Inner(std::size_t n = 0, const Dtype& val = Dtype{}) : BaseVector<Dtype>(n, val)
+        {}
+
+        Inner(std::initializer_list<Dtype> initList) : BaseVector<Dtype>(initList)
+        {}
+
+        /// Copy the elements of a view, e.g. View or RollView
+        template<typename Array, typename = typename std::enable_if<
+                     std::is_same<decltype(std::declval<const Array&>().copy()), Inner<Dtype, 1>>::value>::type>
+        Inner(const Array& view) : Inner(view.copy())
+        {}
+
+        std::array<std::size_t, 1> shape() const
+        {
+            return {{this->size()}};
+        }
+
+        typename BaseVector<Dtype>::reference element(const std::ptrdiff_t* idx)
+        {
+            return this->begin()[*idx];
+        }
+
+        typename BaseVector<Dtype>::const_reference element(const std::ptrdiff_t* idx) const
+        {
+            return this->begin()[*idx];
+        }
+
+        typename BaseVector<Dtype>::const_reference get(const std::array<std::size_t, 1>& idx) const
+        {
+            return this->begin()[idx[0]];
+        }
+
+#if defined(PP_NDARRAY_MDSPAN_NAMESPACE)
+        /// The elements as an mdspan, nothing is copied
+        mdspan<Dtype, 1> as_mdspan() { return mdspan<Dtype, 1>(this->data(), this->size()); }
+        mdspan<const Dtype, 1> as_mdspan() const { return mdspan<const Dtype, 1>(this->data(), this->size()); }
+#endif
+
+        /* Indexing */
+        typename BaseVector<Dtype>::reference operator()(int idx) {
+            return this->at(idx);
+        }
+
+        typename BaseVector<Dtype>::const_reference operator()(int idx) const {
+            return this->at(idx);
+        }
+
+        /// Slice when any argument is not an integer
+        template<typename... Args,
+                 typename std::enable_if<conjunction<is_slice_arg<Args>...>::value, int>::type = 0,
+                 typename std::enable_if<!conjunction<std::is_integral<Args>...>::value, int>::type = 0>
+        Inner<Dtype, slice_rank<1, Args...>::value> operator()(const Args&... args) const
+        {
+            return slice(args...);
+        }
+
+        /* Slicing */
+        Inner<Dtype, 1> operator[](const std::string& input) const
+        {
+            detail::OpTimer timer;
+            const std::vector<SliceArg> slices = parseSlices(input);
+            const View<const Inner<Dtype, 1>, 1> v = View<const Inner<Dtype, 1>, 1>(*this).template apply<1>(slices.data(), slices.size());
+            Inner<Dtype, 1> result = v.copy();
+            timer.done<Dtype>("slice", v);
+            return result;
+        }
+
+        template<std::size_t length>
+        Inner<Dtype, 1> slice(const std::array<Range, length> slices, int start, const int& end) const
+        {
+            if(start == end) return *this;
+
+            return slice(slices[start]);
+        }
+
+        /// @copydoc Inner::slice(const Args&...) const
+        template<typename... Args,
+                 typename std::enable_if<conjunction<is_slice_arg<Args>...>::value, int>::type = 0>
+        Inner<Dtype, slice_rank<1, Args...>::value> slice(const Args&... args) const
+        {
+            detail::OpTimer timer;
+            const View<const Inner<Dtype, 1>, slice_rank<1, Args...>::value> v = view(args...);
+            Inner<Dtype, slice_rank<1, Args...>::value> result = v.copy();
+            timer.done<Dtype>("slice", v);
+            return result;
+        }
+
+        /* Views */
+        template<typename... Args,
+                 typename std::enable_if<conjunction<is_slice_arg<Args>...>::value, int>::type = 0>
+        View<Inner<Dtype, 1>, slice_rank<1, Args...>::value> view(const Args&... args)
+        {
+            return View<Inner<Dtype, 1>, 1>(*this).view(args...);
+        }
+
+        template<typename... Args,
+                 typename std::enable_if<conjunction<is_slice_arg<Args>...>::value, int>::type = 0>
+        View<const Inner<Dtype, 1>, slice_rank<1, Args...>::value> view(const Args&... args) const
+        {
+            return View<const Inner<Dtype, 1>, 1>(*this).view(args...);
+        }
+
+        template<std::size_t rank>
+        View<Inner<Dtype, 1>, rank> view(const std::string& input)
+        {
+            const std::vector<SliceArg> slices = parseSlices(input);
+            return View<Inner<Dtype, 1>, 1>(*this).template apply<rank>(slices.data(), slices.size());
+        }
+
+        template<std::size_t rank>
+        View<const Inner<Dtype, 1>, rank> view(const std::string& input) const
+        {
+            const std::vector<SliceArg> slices = parseSlices(input);
+            return View<const Inner<Dtype, 1>, 1>(*this).template apply<rank>(slices.data(), slices.size());
+        }
+    };
+
+    template<typename Dtype, std::size_t dim> constexpr std::size_t Inner<Dtype, dim>::ndim;
+    template<typename Dtype> constexpr std::size_t Inner<Dtype, 1>::ndim;
+    /** @} */
+
+
+    /**
+     * @addtogroup streaming Streaming stores
+     * Writes which bypass the cache.
+     *
+     * Writing an output much larger than the last level cache through the
+     * cache evicts the rest of the working set for data which will not be
+     * read again soon. Above streaming_threshold() bytes, fill(), copyto()
+     * and the evaluation of expressions write rows of arithmetic types with
+     * non-temporal stores (SSE2), followed by a store fence.
+     *
+     * A std::vector cannot grow without initializing its elements, so
+     * expressions are only streamed into rows which already have the length
+     * of the result, e.g. a reused output. The rows of a new result are
+     * built by appending each element once, through the cache.
+     *
+     * The threshold defaults to PP_NDARRAY_STREAMING_THRESHOLD bytes, about
+     * the size of a large last level cache; `bench/ndarray-streaming.cpp`
+     * measures the crossover on a given machine.
+     * @{
+     */
+
+#ifndef PP_NDARRAY_STREAMING_THRESHOLD
+#define PP_NDARRAY_STREAMING_THRESHOLD (std::size_t(32) << 20)
+#endif
+
+    namespace detail
+    {
+        inline std::size_t& streamingThreshold()
+        {
+            static std::size_t threshold = PP_NDARRAY_STREAMING_THRESHOLD;
+            return threshold;
+        }
+
+        /// Types whose rows are written with streaming stores: a whole number of elements fits in 16 bytes
+        template<typename T>
+        struct is_streamable : std::integral_constant<bool, std::is_arithmetic<T>::value && !std::is_same<T, bool>::value && 16 % sizeof(T) == 0> {};
+
+        /// Whether an output of `count` elements of `T` should be written with streaming stores
+        template<typename T>
+        bool streaming(std::size_t count)
+        {
+            return is_streamable<T>::value && count * sizeof(T) >= streamingThreshold();
+        }
+
+        /// Copy `n` elements with streaming stores, call streamFence() once the whole output is written
+        template<typename T>
+        void streamCopy(T* dst, const T* src, std::size_t n)
+        {
+#if defined(PP_NDARRAY_SSE2)
+            char* d = reinterpret_cast<char*>(dst);
+            const char* s = reinterpret_cast<const char*>(src);
+            std::size_t bytes = n * sizeof(T);
+
+            // Scalar stores up to the first 16 byte boundary of the destination
+            const std::size_t head = std::min(bytes, (16 - (reinterpret_cast<std::uintptr_t>(d) & 15)) & 15);
+            std::memcpy(d, s, head);
+            d += head, s += head, bytes -= head;
+
+            for (; bytes >= 16; d += 16, s += 16, bytes -= 16)
+                _mm_stream_si128(reinterpret_cast<__m128i*>(d), _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+            std::memcpy(d, s, bytes);
+#else
+            std::copy(src, src + n, dst);
+#endif
+        }
+
+        /// Fill `n` elements with streaming stores, call streamFence() once the whole output is written
+        template<typename T>
+        void streamFill(T* dst, const T& value, std::size_t n)
+        {
+#if defined(PP_NDARRAY_SSE2)
+            std::size_t j = 0;
+            for (; j < n && (reinterpret_cast<std::uintptr_t>(dst + j) & 15) != 0; ++j) dst[j] = value;
+
+            T pattern[16 / sizeof(T)];
+            std::fill_n(pattern, 16 / sizeof(T), value);
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+
+            for (; j + 16 / sizeof(T) <= n; j += 16 / sizeof(T))
+                _mm_stream_si128(reinterpret_cast<__m128i*>(dst + j), v);
+            std::fill(dst + j, dst + n, value);
+#else
+            std::fill_n(dst, n, value);
+#endif
+        }
+
+        /// Order the streaming stores before any later store
+        inline void streamFence()
+        {
+#if defined(PP_NDARRAY_SSE2)
+            _mm_sfence();
+#endif
+        }
+
+        template<typename T>
+        void fillRows(Inner<T, 1>& arr, const T& value, bool stream)
+        {
+            if (stream) streamFill(arr.data(), value, arr.size());
+            else std::fill(arr.begin(), arr.end(), value);
+        }
+
+        inline void fillRows(Inner<bool, 1>& arr, const bool& value, bool)
+        {
+            std::fill(arr.begin(), arr.end(), value);
+        }
+
+        template<typename T, std::size_t dim>
+        void fillRows(Inner<T, dim>& arr, const T& value, bool stream)
+        {
+            for (typename Inner<T, dim>::iterator it = arr.begin(); it != arr.end(); ++it) fillRows(*it, value, stream);
+        }
+
+        template<typename T>
+        void copyRows(Inner<T, 1>& dst, const Inner<T, 1>& src, bool stream)
+        {
+            if (stream) streamCopy(dst.data(), src.data(), src.size());
+            else std::copy(src.begin(), src.end(), dst.begin());
+        }
+
+        inline void copyRows(Inner<bool, 1>& dst, const Inner<bool, 1>& src, bool)
+        {
+            std::copy(src.begin(), src.end(), dst.begin());
+        }
+
+        template<typename T, std::size_t dim>
+        void copyRows(Inner<T, dim>& dst, const Inner<T, dim>& src, bool stream)
+        {
+            for (std::size_t i = 0; i < src.size(); ++i) copyRows(dst.begin()[i], src.begin()[i], stream);
+        }
+
+        /// Throws std::invalid_argument unless a destination of shape `out` can hold a result of shape `shape`
+        template<std::size_t dim>
+        void checkShape(const std::array<std::size_t, dim>& out, const std::array<std::size_t, dim>& shape)
+        {
+            if (out != shape) detail::raise<std::invalid_argument>("Shape mismatch");
+        }
+
+        /// Number of elements of an array of shape `shape`
+        template<std::size_t dim>
+        std::size_t product(const std::array<std::size_t, dim>& shape)
+        {
+            std::size_t n = 1;
+            for (std::size_t k = 0; k < dim; ++k) n *= shape[k];
+            return n;
+        }
+    }
+
+    /// Output size in bytes from which streaming stores are used
+    inline std::size_t streaming_threshold()
+    {
+        return detail::streamingThreshold();
+    }
+
+    /// Set the output size in bytes from which streaming stores are used, `SIZE_MAX` disables them
+    inline void set_streaming_threshold(std::size_t bytes)
+    {
+        detail::streamingThreshold() = bytes;
+    }
+
+    /// Set every element of `arr` to `value`
+    template<typename T, std::size_t dim>
+    void fill(Inner<T, dim>& arr, const T& value)
+    {
+        detail::OpTimer timer;
+        const bool stream = detail::streaming<T>(detail::product(arr.shape()));
+        detail::fillRows(arr, value, stream);
+        if (stream) detail::streamFence();
+        timer.done<T>("fill", arr);
+    }
+
+    /**
+     * Copy the elements of `src` into `dst`, which keeps its storage.
+     *
+     * @throws std::invalid_argument if the shapes differ.
+     */
+    template<typename T, std::size_t dim>
+    void copyto(Inner<T, dim>& dst, const Inner<T, dim>& src)
+    {
+        detail::OpTimer timer;
+        detail::checkShape(dst.shape(), src.shape());
+
+        const bool stream = detail::streaming<T>(detail::product(src.shape()));
+        detail::copyRows(dst, src, stream);
+        if (stream) detail::streamFence();
+        timer.done<T>("copyto", src, dst);
+    }
+
+    /** @} */
+
+
+    /**
+     * @addtogroup prefetch Prefetching
+     * Software prefetches for access patterns the hardware does not predict.
+     *
+     * Strided traversals of a View, take() and the reductions of sum() over
+     * an axis jump from row to row of an Inner, and each row is a separate
+     * allocation. They prefetch the element they will read prefetch_distance()
+     * iterations ahead, PP_NDARRAY_PREFETCH_DISTANCE by default; 0 disables
+     * the prefetches.
+     * @{
+     */
+
+#ifndef PP_NDARRAY_PREFETCH_DISTANCE
+#define PP_NDARRAY_PREFETCH_DISTANCE 16
+#endif
+
+    namespace detail
+    {
+        inline std::size_t& prefetchDistance()
+        {
+            static std::size_t distance = PP_NDARRAY_PREFETCH_DISTANCE;
+            return distance;
+        }
+
+        /// Hint that the cache line holding `address` will be read soon
+        inline void prefetch(const void* address)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            __builtin_prefetch(address);
+#elif defined(PP_NDARRAY_SSE2)
+            _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+            (void)address;
+#endif
+        }
+
+        /// Prefetch the start of every row of `arr`
+        template<typename T>
+        void prefetchRows(const Inner<T, 1>& arr)
+        {
+            if (!arr.empty()) prefetch(&*arr.begin());
+        }
+
+        inline void prefetchRows(const Inner<bool, 1>&) {}
+
+        template<typename T, std::size_t dim>
+        void prefetchRows(const Inner<T, dim>& arr)
+        {
+            for (typename Inner<T, dim>::const_iterator it = arr.begin(); it != arr.end(); ++it) prefetchRows(*it);
+        }
+    }
+
+    /// Number of iterations ahead to prefetch
+    inline std::size_t prefetch_distance()
+    {
+        return detail::prefetchDistance();
+    }
+
+    /// Set the number of iterations ahead to prefetch, 0 disables prefetching
+    inline void set_prefetch_distance(std::size_t distance)
+    {
+        detail::prefetchDistance() = distance;
+    }
+
+    /** @} */
+
+
+    /**
+     * @addtogroup workspace Workspace
+     * Reusable scratch memory for the temporaries of an operation.
+     *
+     * Operations which need scratch memory (the packed panels of matmul(),
+     * the row counts of nonzero()) take it from a Workspace instead of
+     * allocating. A Workspace grows to the largest amount used at once and
+     * then keeps its memory, so a loop of operations stops allocating after
+     * its first iteration.
+     *
+     * Each thread has its own Workspace::local(), which these operations use
+     * unless another one is passed explicitly.
+     * @{
+     */
+
+    /**
+     * A stack of aligned scratch buffers.
+     *
+     * Buffers are taken with allocate() inside a Workspace::Scope, and are
+     * all given back when the scope ends. If a scope needs more memory than
+     * the workspace has, an extra block is allocated; once the outermost
+     * scope ends, the blocks are merged into one block of the high-water
+     * size, which is kept.
+     */
+    class Workspace
+    {
+    public:
+        /// Alignment of every buffer, a cache line
+        static constexpr std::size_t alignment = 64;
+
+        /// Give back every buffer allocated since the scope began
+        class Scope
+        {
+        public:
+            explicit Scope(Workspace& workspace)
+                : workspace_(workspace), block_(workspace.block_), offset_(workspace.offset_), used_(workspace.used_)
+            {
+                ++workspace_.depth_;
+            }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+            ~Scope()
+            {
+                workspace_.block_ = block_;
+                workspace_.offset_ = offset_;
+                workspace_.used_ = used_;
+                if (--workspace_.depth_ == 0) workspace_.merge();
+            }
+
+        private:
+            Workspace& workspace_;
+            std::size_t block_, offset_, used_;
+        };
+
+        Workspace() : block_(0), offset_(0), used_(0), highWater_(0), depth_(0) {}
+
+        ~Workspace()
+        {
+            release();
+        }
+
+        Workspace(const Workspace&) = delete;
+        Workspace& operator=(const Workspace&) = delete;
+
+        /// Scratch workspace of the calling thread
+        static Workspace& local()
+        {
+            static thread_local Workspace workspace;
+            return workspace;
+        }
+
+        /**
+         * Uninitialized buffer of `n` elements, aligned to Workspace::alignment.
+         *
+         * The buffer is valid until the innermost Scope ends.
+         */
+        template<typename T>
+        T* allocate(std::size_t n)
+        {
+            static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value, "Workspace buffers hold trivial types");
+            static_assert(alignof(T) <= alignment, "Type is over-aligned");
+
+            const std::size_t bytes = (n * sizeof(T) + alignment - 1) / alignment * alignment;
+            while (block_ < blocks_.size() && offset_ + bytes > blocks_[block_].size)
+            {
+                ++block_;
+                offset_ = 0;
+            }
+            if (block_ == blocks_.size())
+            {
+                blocks_.push_back(Block::make(std::max(bytes, capacity())));
+                detail::count(detail::MetricsBlock::workspace_misses, 1);
+            }
+            else detail::count(detail::MetricsBlock::workspace_hits, 1);
+
+            T* result = reinterpret_cast<T*>(blocks_[block_].data + offset_);
+            offset_ += bytes;
+            used_ += bytes;
+            highWater_ = std::max(highWater_, used_);
+            return result;
+        }
+
+        /// Bytes held by the workspace
+        std::size_t capacity() const
+        {
+            std::size_t total = 0;
+            for (std::size_t b = 0; b < blocks_.size(); ++b) total += blocks_[b].size;
+            return total;
+        }
+
+        /// Most bytes in use at once
+        std::size_t high_water() const { return highWater_; }
+
+        /// Free all the memory, which must not be in use
+        void release()
+        {
+            for (std::size_t b = 0; b < blocks_.size(); ++b) Block::free(blocks_[b]);
+            blocks_.clear();
+            block_ = offset_ = used_ = 0;
+        }
+
+    private:
+        struct Block
+        {
+            char* data;
+            char* raw;
+            std::size_t size;
+            const char* tag;    ///< MemoryTag the block is charged to
+
+            static Block make(std::size_t size)
+            {
+                Block block;
+                block.raw = static_cast<char*>(::operator new(size + alignment - 1));
+                block.data = block.raw + (alignment - reinterpret_cast<std::uintptr_t>(block.raw) % alignment) % alignment;
+                block.size = size;
+                block.tag = detail::memoryTag() ? detail::memoryTag() : "untagged";
+                detail::countAllocation(block.tag, static_cast<std::int64_t>(size + alignment - 1));
+                return block;
+            }
+
+            static void free(const Block& block)
+            {
+                detail::countAllocation(block.tag, -static_cast<std::int64_t>(block.size + alignment - 1));
+                ::operator delete(block.raw);
+            }
+        };
+
+        std::vector<Block> blocks_;
+        std::size_t block_, offset_, used_, highWater_, depth_;
+
+        /// Replace several blocks by one large enough for the high-water mark
+        void merge()
+        {
+            if (blocks_.size() <= 1) return;
+
+            release();
+            blocks_.push_back(Block::make(highWater_));
+        }
+    };
+
+    /** @} */
+
+
+    /**
+     * @addtogroup view View
+     * Views of an Inner which never copy.
+     *
+     * A View keeps a pointer to the array it was taken from, and maps its own
+     * indices onto the indices of that array:
+     *
+     *     source index = origin + i[0] * strides[0] + i[1] * strides[1] + ...
+     *
+     * where `origin` and each stride have one entry per axis of the source.
+     * Slicing a View, adding axes with pp::newaxis or expanding pp::ellipsis
+     * only change this mapping, the data is only read when it is accessed or
+     * copied into an Inner.
+     *
+     * A View does not own the data, the source must outlive it.
+     *
+     * ### Example
+     * @include ndarray-view.cpp
+     * @{
+     */
+
+    /// Non-owning view of an Inner, `Source` is `Inner<Dtype, N>` or `const Inner<Dtype, N>`
+    template<typename Source, std::size_t dim>
+    struct View
+    {
+        static_assert(dim >= 1, "Dimension must be greater than zero!");
+
+        using source_type = typename std::remove_const<Source>::type;
+        using dtype = typename source_type::dtype;
+        using reference = decltype(std::declval<Source&>().element(std::declval<const std::ptrdiff_t*>()));  ///< A value when the source computes its elements
+        static constexpr std::size_t ndim = dim;
+
+        /// A position, or a step, over the axes of the source
+        using Index = std::array<std::ptrdiff_t, source_type::ndim>;
+
+        /// View of the whole source
+        explicit View(Source& source) : source_(&source), shape_(), origin_(), strides_()
+        {
+            static_assert(dim == source_type::ndim, "A whole view has the dimension of its source");
+
+            shape_ = source.shape();
+            for (std::size_t k = 0; k < dim; ++k) strides_[k][k] = 1;
+        }
+
+        std::array<std::size_t, dim> shape() const { return shape_; }   ///< Length of each axis
+        const std::array<Index, dim>& strides() const { return strides_; }  ///< Step of each axis over the source
+        const Index& origin() const { return origin_; }                  ///< Source position of the first element
+        Source& source() const { return *source_; }                      ///< The viewed array
+
+        /// Indexing, with negative indices counting from the end
+        template<typename... Indices,
+                 typename std::enable_if<sizeof...(Indices) == dim, int>::type = 0,
+                 typename std::enable_if<conjunction<std::is_integral<Indices>...>::value, int>::type = 0>
+        reference operator()(Indices... indices) const
+        {
+            const std::ptrdiff_t idx[] = {static_cast<std::ptrdiff_t>(indices)...};
+
+            Index pos = origin_;
+            for (std::size_t k = 0; k < dim; ++k)
+            {
+                std::ptrdiff_t i = idx[k];
+                if (i < 0) i += shape_[k];
+                if (i < 0 || i >= static_cast<std::ptrdiff_t>(shape_[k])) detail::raise<std::out_of_range>("Index out of range");
+                advance(pos, strides_[k], i);
+            }
+
+            return source_->element(pos.data());
+        }
+
+        /// Unchecked access to the element at `idx`
+        reference get(const std::array<std::size_t, dim>& idx) const
+        {
+            Index pos = origin_;
+            for (std::size_t k = 0; k < dim; ++k) advance(pos, strides_[k], static_cast<std::ptrdiff_t>(idx[k]));
+            return source_->element(pos.data());
+        }
+
+        /// Slicing, returns a View of the same source
+        template<typename... Args,
+                 typename std::enable_if<conjunction<is_slice_arg<Args>...>::value, int>::type = 0,
+                 typename std::enable_if<!(sizeof...(Args) == dim && conjunction<std::is_integral<Args>...>::value), int>::type = 0>
+        View<Source, slice_rank<dim, Args...>::value> operator()(const Args&... args) const
+        {
+            return view(args...);
+        }
+
+        /// @copydoc Inner::view(const Args&...)
+        template<typename... Args,
+                 typename std::enable_if<conjunction<is_slice_arg<Args>...>::value, int>::type = 0>
+        View<Source, slice_rank<dim, Args...>::value> view(const Args&... args) const
+        {
+            static_assert(count_if<is_axis_arg, Args...>::value <= dim, "Too many slices");
+            static_assert(count_if<is_ellipsis, Args...>::value <= 1, "Only one ellipsis is allowed");
+            static_assert(count_if<std::is_integral, Args...>::value < dim + count_if<is_newaxis, Args...>::value,
+                          "Use operator() to access a single element");
+
+            const SliceArg slices[] = {SliceArg(args)..., SliceArg(All())};
+            return apply<slice_rank<dim, Args...>::value>(slices, sizeof...(Args));
+        }
+
+        /**
+         * Apply `n` slicing arguments, checked at runtime.
+         *
+         * @throw std::invalid_argument if the arguments do not give a `rank` dimensional View
+         * @throw std::out_of_range if an index is out of range
+         */
+        template<std::size_t rank>
+        View<Source, rank> apply(const SliceArg* slices, std::size_t n) const
+        {
+            std::size_t axes = 0, indices = 0, added = 0, ellipses = 0;
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                switch (slices[i].kind)
+                {
+                    case SliceArg::index:    ++axes; ++indices; break;
+                    case SliceArg::range:    ++axes; break;
+                    case SliceArg::newaxis:  ++added; break;
+                    case SliceArg::ellipsis: ++ellipses; break;
+                }
+            }
+
+            if (axes > dim) detail::raise<std::invalid_argument>("Too many slices");
+            if (ellipses > 1) detail::raise<std::invalid_argument>("Only one ellipsis is allowed");
+            if (dim + added - indices != rank) detail::raise<std::invalid_argument>("Slices do not match the dimension of the result");
+
+            View<Source, rank> result(source_);
+            result.origin_ = origin_;
+
+            std::size_t in = 0, out = 0;
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                const SliceArg& s = slices[i];
+                switch (s.kind)
+                {
+                    case SliceArg::index:
+                    {
+                        std::ptrdiff_t idx = s.idx;
+                        if (idx < 0) idx += shape_[in];
+                        if (idx < 0 || idx >= static_cast<std::ptrdiff_t>(shape_[in])) detail::raise<std::out_of_range>("Index out of range");
+                        advance(result.origin_, strides_[in], idx);
+                        ++in;
+                        break;
+                    }
+                    case SliceArg::range:
+                    {
+                        Range::Bounds b = s.slice.resolve(shape_[in]);
+                        advance(result.origin_, strides_[in], b.start);
+                        result.shape_[out] = b.length;
+                        for (std::size_t j = 0; j < source_type::ndim; ++j) result.strides_[out][j] = strides_[in][j] * b.step;
+                        ++in; ++out;
+                        break;
+                    }
+                    case SliceArg::newaxis:
+                    {
+                        result.shape_[out] = 1;
+                        result.strides_[out] = Index();
+                        ++out;
+                        break;
+                    }
+                    case SliceArg::ellipsis:
+                    {
+                        for (std::size_t k = axes; k < dim; ++k, ++in, ++out)
+                        {
+                            result.shape_[out] = shape_[in];
+                            result.strides_[out] = strides_[in];
+                        }
+                        break;
+                    }
+                }
+            }
+
+            for (; in < dim; ++in, ++out)
+            {
+                result.shape_[out] = shape_[in];
+                result.strides_[out] = strides_[in];
+            }
+
+            return result;
+        }
+
+        /**
+         * Build a `rank` dimensional View from the steps of its axes over this View.
+         *
+         * The element `(i[0], ..., i[rank-1])` of the result is the element
+         * `origin + i[0] * steps[0] + ... + i[rank-1] * steps[rank-1]` of this View.
+         * Steps may be zero or negative, and several axes may move along the same
+         * axis of this View, so the result may overlap itself.
+         *
+         * @throw std::out_of_range if the result reaches outside of this View
+         */
+        template<std::size_t rank>
+        View<Source, rank> asStrided(const std::array<std::size_t, rank>& shape,
+                                     const std::array<std::array<std::ptrdiff_t, dim>, rank>& steps,
+                                     const std::array<std::ptrdiff_t, dim>& origin) const
+        {
+            const bool empty = std::find(shape.begin(), shape.end(), 0) != shape.end();
+            for (std::size_t k = 0; k < dim && !empty; ++k)
+            {
+                std::ptrdiff_t lo = origin[k], hi = origin[k];
+                for (std::size_t v = 0; v < rank; ++v)
+                {
+                    const std::ptrdiff_t extent = steps[v][k] * static_cast<std::ptrdiff_t>(shape[v] - 1);
+                    (extent < 0? lo: hi) += extent;
+                }
+                if (lo < 0 || hi >= static_cast<std::ptrdiff_t>(shape_[k])) detail::raise<std::out_of_range>("Strided view reaches outside of the array");
+            }
+
+            View<Source, rank> result(source_);
+            result.shape_ = shape;
+            result.origin_ = origin_;
+            for (std::size_t k = 0; k < dim; ++k)
+            {
+                advance(result.origin_, strides_[k], origin[k]);
+                for (std::size_t v = 0; v < rank; ++v) advance(result.strides_[v], strides_[k], steps[v][k]);
+            }
+
+            return result;
+        }
+
+        /// Copy the viewed elements into a new Inner
+        Inner<dtype, dim> copy() const
+        {
+            detail::OpTimer timer;
+            detail::InheritTag tag(detail::tagOf(*source_, 0));
+            Inner<dtype, dim> result;
+            fill<0>(result, origin_, dim, 0, std::integral_constant<bool, dim == 1>());
+            timer.done<dtype>("View::copy", *this);
+            return result;
+        }
+
+        /**
+         * Copy the elements into `out`, which keeps its storage.
+         *
+         * @throws std::invalid_argument if the shape of `out` differs.
+         */
+        void copy(Inner<dtype, dim>& out) const
+        {
+            detail::OpTimer timer;
+            detail::checkShape(out.shape(), shape_);
+            fill<0>(out, origin_, dim, 0, std::integral_constant<bool, dim == 1>());
+            timer.done<dtype>("View::copy", *this);
+        }
+
+        /// Copy when assigned to an Inner
+        operator Inner<dtype, dim>() const
+        {
+            return copy();
+        }
+
+        std::string toString(int indentLevel = 0) const
+        {
+            return copy().toString(indentLevel);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const View& view)
+        {
+            return os << view.toString();
+        }
+
+    private:
+        template<typename, std::size_t> friend struct View;
+        template<typename, std::size_t> friend struct RollView;
+        template<typename> friend struct BandView;
+
+        explicit View(Source* source) : source_(source), shape_(), origin_(), strides_()
+        {}
+
+        static void advance(Index& pos, const Index& step, std::ptrdiff_t times = 1)
+        {
+            for (std::size_t j = 0; j < source_type::ndim; ++j) pos[j] += step[j] * times;
+        }
+
+        /// Check if the step moves to the next element of the same row of the source
+        static bool isContiguous(const Index& step)
+        {
+            for (std::size_t j = 0; j + 1 < source_type::ndim; ++j)
+                if (step[j] != 0) return false;
+            return step[source_type::ndim - 1] == 1;
+        }
+
+        /// Copy into `out`, with the elements along `rollAxis` rotated right by `shift`
+        template<std::size_t k>
+        void fill(Inner<dtype, dim - k>& out, const Index& pos, std::size_t rollAxis, std::size_t shift, std::false_type) const
+        {
+            const std::size_t n = shape_[k];
+            const std::size_t s = (k == rollAxis)? shift: 0;
+
+            out.resize(n);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                Index p = pos;
+                advance(p, strides_[k], static_cast<std::ptrdiff_t>(i < s? i + n - s: i - s));
+                fill<k + 1>(out.begin()[i], p, rollAxis, shift, std::integral_constant<bool, k + 2 == dim>());
+            }
+        }
+
+        template<std::size_t k>
+        void fill(Inner<dtype, 1>& out, const Index& pos, std::size_t rollAxis, std::size_t shift, std::true_type) const
+        {
+            const std::size_t n = shape_[k];
+            const std::size_t s = (k == rollAxis)? shift: 0;
+
+            // [n - s, n) goes first, then [0, n - s)
+            Index tail = pos;
+            advance(tail, strides_[k], static_cast<std::ptrdiff_t>(n - s));
+
+            // Overwrite a row which already has the length n, or build it by appending each element once
+            if (out.size() != n)
+            {
+                out.clear();
+                out.reserve(n);
+                copyRow(std::back_inserter(out), tail, s, strides_[k]);
+                copyRow(std::back_inserter(out), pos, n - s, strides_[k]);
+                return;
+            }
+
+            copyRow(out.begin(), tail, s, strides_[k]);
+            copyRow(out.begin() + s, pos, n - s, strides_[k]);
+        }
+
+        template<typename OutputIt>
+        void copyRow(OutputIt out, Index pos, std::size_t n, const Index& step) const
+        {
+            if (n == 0) return;
+
+            if (isContiguous(step) && copyContiguous(out, pos, n, std::is_lvalue_reference<reference>()))
+                return;
+
+            // Each step may land in another row of the source, prefetch the element `distance` steps ahead
+            std::size_t i = 0;
+            const std::size_t distance = prefetch_distance();
+            if (distance != 0 && distance < n && std::is_lvalue_reference<reference>::value)
+            {
+                Index ahead = pos;
+                advance(ahead, step, static_cast<std::ptrdiff_t>(distance));
+                for (; i + distance < n; ++i, ++out)
+                {
+                    prefetchElement(ahead, std::is_lvalue_reference<reference>());
+                    *out = source_->element(pos.data());
+                    advance(pos, step);
+                    advance(ahead, step);
+                }
+            }
+
+            for (; i < n; ++i, ++out)
+            {
+                *out = source_->element(pos.data());
+                advance(pos, step);
+            }
+        }
+
+        void prefetchElement(const Index& pos, std::true_type) const
+        {
+            detail::prefetch(&source_->element(pos.data()));
+        }
+
+        void prefetchElement(const Index&, std::false_type) const {}
+
+        /// Copy `n` elements stored next to each other in the source, if they are stored at all
+        template<typename OutputIt>
+        bool copyContiguous(OutputIt out, const Index& pos, std::size_t n, std::true_type) const
+        {
+            const dtype* first = &source_->element(pos.data());
+            std::copy(first, first + n, out);
+            return true;
+        }
+
+        template<typename OutputIt>
+        bool copyContiguous(OutputIt, const Index&, std::size_t, std::false_type) const
+        {
+            return false;
+        }
+
+        Source* source_;
+        std::array<std::size_t, dim> shape_;
+        Index origin_;
+        std::array<Index, dim> strides_;
+    };
+
+    template<typename Source, std::size_t dim> constexpr std::size_t View<Source, dim>::ndim;
+
+    /**
+     * View of a View whose elements along one axis are rotated, see roll().
+     *
+     * Elements are read through the wrapped View with the rotated index, and
+     * copying it copies each row as two contiguous segments.
+     */
+    template<typename Source, std::size_t dim>
+    struct RollView
+    {
+        using dtype = typename View<Source, dim>::dtype;
+        using reference = typename View<Source, dim>::reference;
+        static constexpr std::size_t ndim = dim;
+
+        /// Rotate `view` by `shift` along `axis`, a negative shift rotates left
+        RollView(const View<Source, dim>& view, std::ptrdiff_t shift, std::size_t axis) : view_(view), axis_(axis), shift_(0)
+        {
+            if (axis >= dim) detail::raise<std::out_of_range>("Axis out of range");
+
+            const std::ptrdiff_t n = static_cast<std::ptrdiff_t>(view.shape()[axis]);
+            if (n > 0) shift_ = static_cast<std::size_t>((shift % n + n) % n);
+        }
+
+        std::array<std::size_t, dim> shape() const { return view_.shape(); }   ///< Length of each axis
+        std::size_t axis() const { return axis_; }                              ///< The rotated axis
+        std::size_t shift() const { return shift_; }                            ///< Rotation, between 0 and the length of the axis
+
+        /// Indexing, with negative indices counting from the end
+        template<typename... Indices,
+                 typename std::enable_if<sizeof...(Indices) == dim, int>::type = 0,
+                 typename std::enable_if<conjunction<std::is_integral<Indices>...>::value, int>::type = 0>
+        reference operator()(Indices... indices) const
+        {
+            const std::ptrdiff_t idx[] = {static_cast<std::ptrdiff_t>(indices)...};
+            const std::array<std::size_t, dim> shape = view_.shape();
+
+            std::array<std::size_t, dim> pos;
+            for (std::size_t k = 0; k < dim; ++k)
+            {
+                std::ptrdiff_t i = idx[k];
+                if (i < 0) i += shape[k];
+                if (i < 0 || i >= static_cast<std::ptrdiff_t>(shape[k])) detail::raise<std::out_of_range>("Index out of range");
+                pos[k] = static_cast<std::size_t>(i);
+            }
+
+            return get(pos);
+        }
+
+        /// Unchecked access to the element at `idx`
+        reference get(std::array<std::size_t, dim> idx) const
+        {
+            const std::size_t n = view_.shape_[axis_];
+            idx[axis_] = (idx[axis_] < shift_)? idx[axis_] + n - shift_: idx[axis_] - shift_;
+            return view_.get(idx);
+        }
+
+        /// Copy the rotated elements into a new Inner
+        Inner<dtype, dim> copy() const
+        {
+            detail::OpTimer timer;
+            detail::InheritTag tag(detail::tagOf(view_.source(), 0));
+            Inner<dtype, dim> result;
+            view_.template fill<0>(result, view_.origin_, axis_, shift_, std::integral_constant<bool, dim == 1>());
+            timer.done<dtype>("RollView::copy", view_);
+            return result;
+        }
+
+        /**
+         * Copy the elements into `out`, which keeps its storage.
+         *
+         * @throws std::invalid_argument if the shape of `out` differs.
+         */
+        void copy(Inner<dtype, dim>& out) const
+        {
+            detail::OpTimer timer;
+            detail::checkShape(out.shape(), view_.shape());
+            view_.template fill<0>(out, view_.origin_, axis_, shift_, std::integral_constant<bool, dim == 1>());
+            timer.done<dtype>("RollView::copy", view_);
+        }
+
+        /// Copy when assigned to an Inner
+        operator Inner<dtype, dim>() const
+        {
+            return copy();
+        }
+
+        std::string toString(int indentLevel = 0) const
+        {
+            return copy().toString(indentLevel);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const RollView& view)
+        {
+            return os << view.toString();
+        }
+
+    private:
+        View<Source, dim> view_;
+        std::size_t axis_;
+        std::size_t shift_;
+    };
+
+    template<typename Source, std::size_t dim> constexpr std::size_t RollView<Source, dim>::ndim;
+
+    /**
+     * View of a 2D View where only a band of diagonals is kept, see band().
+     *
+     * The kept elements are those where `-lower <= column - row <= upper`, the
+     * others read as zero and are never stored nor visited. Kernels can iterate
+     * over the kept part of each row with columns() and row().
+     */
+    template<typename Source>
+    struct BandView
+    {
+        using dtype = typename View<Source, 2>::dtype;
+        static constexpr std::size_t ndim = 2;
+
+        /// Keep the main diagonal of `view`, `lower` diagonals below it and `upper` diagonals above it
+        BandView(const View<Source, 2>& view, std::ptrdiff_t lower, std::ptrdiff_t upper) : view_(view), lower_(-lower), upper_(upper)
+        {}
+
+        std::array<std::size_t, 2> shape() const { return view_.shape(); }  ///< Length of each axis
+        std::ptrdiff_t lower() const { return -lower_; }                    ///< Number of kept diagonals below the main one
+        std::ptrdiff_t upper() const { return upper_; }                     ///< Number of kept diagonals above the main one
+
+        /// First and past the last kept columns of row `i`
+        std::pair<std::size_t, std::size_t> columns(std::size_t i) const
+        {
+            const std::ptrdiff_t row = static_cast<std::ptrdiff_t>(i);
+            const std::ptrdiff_t cols = static_cast<std::ptrdiff_t>(view_.shape_[1]);
+
+            const std::ptrdiff_t first = (lower_ <= -row)? 0: std::min(row + lower_, cols);
+            const std::ptrdiff_t last  = (upper_ >= cols - 1 - row)? cols: std::max(row + upper_ + 1, first);
+
+            return std::make_pair(static_cast<std::size_t>(first), static_cast<std::size_t>(std::max(first, last)));
+        }
+
+        /// View of the kept elements of row `i`, starting at column `columns(i).first`
+        View<Source, 1> row(std::size_t i) const
+        {
+            const std::pair<std::size_t, std::size_t> cols = columns(i);
+
+            std::array<std::ptrdiff_t, 2> origin = {{static_cast<std::ptrdiff_t>(i), static_cast<std::ptrdiff_t>(cols.first)}};
+            std::array<std::array<std::ptrdiff_t, 2>, 1> steps = {{ {{0, 1}} }};
+
+            return view_.template asStrided<1>({{cols.second - cols.first}}, steps, origin);
+        }
+
+        /// Indexing, with negative indices counting from the end
+        dtype operator()(std::ptrdiff_t i, std::ptrdiff_t j) const
+        {
+            const std::array<std::size_t, 2> shape = view_.shape();
+            if (i < 0) i += shape[0];
+            if (j < 0) j += shape[1];
+            if (i < 0 || j < 0 || i >= static_cast<std::ptrdiff_t>(shape[0]) || j >= static_cast<std::ptrdiff_t>(shape[1]))
+                detail::raise<std::out_of_range>("Index out of range");
+
+            return get({{static_cast<std::size_t>(i), static_cast<std::size_t>(j)}});
+        }
+
+        /// Unchecked access to the element at `idx`
+        dtype get(const std::array<std::size_t, 2>& idx) const
+        {
+            const std::ptrdiff_t diag = static_cast<std::ptrdiff_t>(idx[1]) - static_cast<std::ptrdiff_t>(idx[0]);
+            return (diag < lower_ || diag > upper_)? dtype(): view_.get(idx);
+        }
+
+        /// Copy into a new Inner, with zeros outside of the band
+        Inner<dtype, 2> copy() const
+        {
+            const std::array<std::size_t, 2> shape = view_.shape();
+            Inner<dtype, 2> result(shape[0], shape[1]);
+
+            for (std::size_t i = 0; i < shape[0]; ++i)
+            {
+                const std::pair<std::size_t, std::size_t> cols = columns(i);
+
+                typename View<Source, 2>::Index pos = view_.origin_;
+                View<Source, 2>::advance(pos, view_.strides_[0], static_cast<std::ptrdiff_t>(i));
+                View<Source, 2>::advance(pos, view_.strides_[1], static_cast<std::ptrdiff_t>(cols.first));
+
+                view_.copyRow(result.begin()[i].begin() + cols.first, pos, cols.second - cols.first, view_.strides_[1]);
+            }
+
+            return result;
+        }
+
+        /// Copy when assigned to an Inner
+        operator Inner<dtype, 2>() const
+        {
+            return copy();
+        }
+
+        std::string toString(int indentLevel = 0) const
+        {
+            return copy().toString(indentLevel);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const BandView& view)
+        {
+            return os << view.toString();
+        }
+
+    private:
+        View<Source, 2> view_;
+        std::ptrdiff_t lower_;  ///< Lowest kept diagonal
+        std::ptrdiff_t upper_;  ///< Highest kept diagonal
+    };
+
+    template<typename Source> constexpr std::size_t BandView<Source>::ndim;
+
+    /**
+     * View with the given shape and steps, see View::asStrided().
+     *
+     * Unlike NumPy, steps count elements along each axis of `arr` rather than
+     * bytes, and the result is checked to stay inside of `arr`.
+     *
+     * @code
+     * pp::Ndarray<int[1]> signal = {0, 1, 2, 3, 4};
+     * // 3 overlapping pairs starting at 1: [[1, 2], [2, 3], [3, 4]]
+     * auto pairs = pp::as_strided<2>(signal, {{3, 2}}, {{ {{1}}, {{1}} }}, {{1}});
+     * @endcode
+     */
+    template<std::size_t rank, typename Source, std::size_t dim>
+    View<Source, rank> as_strided(const View<Source, dim>& arr,
+                                  const std::array<std::size_t, rank>& shape,
+                                  const std::array<std::array<std::ptrdiff_t, dim>, rank>& steps,
+                                  const std::array<std::ptrdiff_t, dim>& origin = std::array<std::ptrdiff_t, dim>())
+    {
+        return arr.template asStrided<rank>(shape, steps, origin);
+    }
+
+    template<std::size_t rank, typename Dtype, std::size_t dim>
+    View<Inner<Dtype, dim>, rank> as_strided(Inner<Dtype, dim>& arr,
+                                             const std::array<std::size_t, rank>& shape,
+                                             const std::array<std::array<std::ptrdiff_t, dim>, rank>& steps,
+                                             const std::array<std::ptrdiff_t, dim>& origin = std::array<std::ptrdiff_t, dim>())
+    {
+        return as_strided<rank>(arr.view(), shape, steps, origin);
+    }
+
+    template<std::size_t rank, typename Dtype, std::size_t dim>
+    View<const Inner<Dtype, dim>, rank> as_strided(const Inner<Dtype, dim>& arr,
+                                                   const std::array<std::size_t, rank>& shape,
+                                                   const std::array<std::array<std::ptrdiff_t, dim>, rank>& steps,
+                                                   const std::array<std::ptrdiff_t, dim>& origin = std::array<std::ptrdiff_t, dim>())
+    {
+        return as_strided<rank>(arr.view(), shape, steps, origin);
+    }
+
+    /**
+     * View of all the windows of length `window` along `axis`.
+     *
+     * The windows overlap and nothing is copied. The result has one more axis
+     * than `arr`: `axis` is shortened to the number of windows, and the last
+     * axis goes along a window.
+     *
+     * @code
+     * pp::Ndarray<int[1]> signal = {0, 1, 2, 3, 4};
+     * auto windows = pp::sliding_window_view(signal, 3, 0);
+     * // [[0, 1, 2], [1, 2, 3], [2, 3, 4]]
+     * @endcode
+     *
+     * @throw std::out_of_range if `axis` is not an axis of `arr`
+     * @throw std::invalid_argument if `window` is longer than the axis
+     */
+    template<typename Source, std::size_t dim>
+    View<Source, dim + 1> sliding_window_view(const View<Source, dim>& arr, std::size_t window, std::size_t axis = dim - 1)
+    {
+        if (axis >= dim) detail::raise<std::out_of_range>("Axis out of range");
+
+        const std::array<std::size_t, dim> in = arr.shape();
+        if (window > in[axis]) detail::raise<std::invalid_argument>("Window is longer than the axis");
+
+        std::array<std::size_t, dim + 1> shape;
+        std::array<std::array<std::ptrdiff_t, dim>, dim + 1> steps = {};
+        for (std::size_t k = 0; k < dim; ++k)
+        {
+            shape[k] = in[k];
+            steps[k][k] = 1;
+        }
+        shape[axis] = in[axis] - window + 1;
+        shape[dim] = window;
+        steps[dim][axis] = 1;
+
+        return as_strided<dim + 1>(arr, shape, steps);
+    }
+
+    /// View of all the windows of shape `window_shape`, the result has twice the axes of `arr`
+    template<typename Source, std::size_t dim>
+    View<Source, 2 * dim> sliding_window_view(const View<Source, dim>& arr, const std::array<std::size_t, dim>& window_shape)
+    {
+        const std::array<std::size_t, dim> in = arr.shape();
+
+        std::array<std::size_t, 2 * dim> shape;
+        std::array<std::array<std::ptrdiff_t, dim>, 2 * dim> steps = {};
+        for (std::size_t k = 0; k < dim; ++k)
+        {
+            if (window_shape[k] > in[k]) detail::raise<std::invalid_argument>("Window is longer than the axis");
+            shape[k] = in[k] - window_shape[k] + 1;
+            shape[dim + k] = window_shape[k];
+            steps[k][k] = 1;
+            steps[dim + k][k] = 1;
+        }
+
+        return as_strided<2 * dim>(arr, shape, steps);
+    }
+
+    template<typename Dtype, std::size_t dim>
+    View<Inner<Dtype, dim>, dim + 1> sliding_window_view(Inner<Dtype, dim>& arr, std::size_t window, std::size_t axis = dim - 1)
+    {
+        return sliding_window_view(arr.view(), window, axis);
+    }
+
+    template<typename Dtype, std::size_t dim>
+    View<const Inner<Dtype, dim>, dim + 1> sliding_window_view(const Inner<Dtype, dim>& arr, std::size_t window, std::size_t axis = dim - 1)
+    {
+        return sliding_window_view(arr.view(), window, axis);
+    }
+
+    template<typename Dtype, std::size_t dim>
+    View<Inner<Dtype, dim>, 2 * dim> sliding_window_view(Inner<Dtype, dim>& arr, const std::array<std::size_t, dim>& window_shape)
+    {
+        return sliding_window_view(arr.view(), window_shape);
+    }
+
+    template<typename Dtype, std::size_t dim>
+    View<const Inner<Dtype, dim>, 2 * dim> sliding_window_view(const Inner<Dtype, dim>& arr, const std::array<std::size_t, dim>& window_shape)
+    {
+        return sliding_window_view(arr.view(), window_shape);
+    }
+
+    /**
+     * View of `arr` with the order of the elements along `axis` reversed.
+     *
+     * The axis gets a negative step, nothing is copied.
+     *
+     * @throw std::out_of_range if `axis` is not an axis of `arr`
+     */
+    template<typename Source, std::size_t dim>
+    View<Source, dim> flip(const View<Source, dim>& arr, std::size_t axis)
+    {
+        if (axis >= dim) detail::raise<std::out_of_range>("Axis out of range");
+
+        const std::array<std::size_t, dim> shape = arr.shape();
+        std::array<std::array<std::ptrdiff_t, dim>, dim> steps = {};
+        std::array<std::ptrdiff_t, dim> origin = {};
+        for (std::size_t k = 0; k < dim; ++k) steps[k][k] = 1;
+
+        steps[axis][axis] = -1;
+        if (shape[axis] > 0) origin[axis] = static_cast<std::ptrdiff_t>(shape[axis] - 1);
+
+        return as_strided<dim>(arr, shape, steps, origin);
+    }
+
+    /// View of `arr` with the order of the elements reversed along every axis
+    template<typename Source, std::size_t dim>
+    View<Source, dim> flip(const View<Source, dim>& arr)
+    {
+        View<Source, dim> result = arr;
+        for (std::size_t k = 0; k < dim; ++k) result = flip(result, k);
+        return result;
+    }
+
+    template<typename Dtype, std::size_t dim>
+    View<Inner<Dtype, dim>, dim> flip(Inner<Dtype, dim>& arr, std::size_t axis)
+    {
+        return flip(arr.view(), axis);
+    }
+
+    template<typename Dtype, std::size_t dim>
+    View<const Inner<Dtype, dim>, dim> flip(const Inner<Dtype, dim>& arr, std::size_t axis)
+    {
+        return flip(arr.view(), axis);
+    }
+
+    template<typename Dtype, std::size_t dim>
+    View<Inner<Dtype, dim>, dim> flip(Inner<Dtype, dim>& arr)
+    {
+        return flip(arr.view());
+    }
+
+    template<typename Dtype, std::size_t dim>
+    View<const Inner<Dtype, dim>, dim> flip(const Inner<Dtype, dim>& arr)
+    {
+        return flip(arr.view());
+    }
+
+    /**
+     * Rotate the elements of `arr` along `axis`, like `numpy.roll()`.
+     *
+     * The element `i` moves to `i + shift`, and the elements past the end wrap
+     * around to the beginning. Nothing is copied until the result is copied
+     * into an Inner, then each row is copied as two segments.
+     *
+     * @code
+     * pp::Ndarray<int[1]> signal = {0, 1, 2, 3, 4};
+     * pp::Ndarray<int[1]> rolled = pp::roll(signal, 2, 0);   // [3, 4, 0, 1, 2]
+     * @endcode
+     *
+     * @throw std::out_of_range if `axis` is not an axis of `arr`
+     */
+    template<typename Source, std::size_t dim>
+    RollView<Source, dim> roll(const View<Source, dim>& arr, std::ptrdiff_t shift, std::size_t axis)
+    {
+        return RollView<Source, dim>(arr, shift, axis);
+    }
+
+    template<typename Dtype, std::size_t dim>
+    RollView<Inner<Dtype, dim>, dim> roll(Inner<Dtype, dim>& arr, std::ptrdiff_t shift, std::size_t axis)
+    {
+        return roll(arr.view(), shift, axis);
+    }
+
+    template<typename Dtype, std::size_t dim>
+    RollView<const Inner<Dtype, dim>, dim> roll(const Inner<Dtype, dim>& arr, std::ptrdiff_t shift, std::size_t axis)
+    {
+        return roll(arr.view(), shift, axis);
+    }
+
+    /**
+     * View of the diagonal `offset` of a 2D array.
+     *
+     * 0 is the main diagonal, positive offsets are above it and negative ones
+     * below. The diagonal is a 1D View stepping one row and one column at a
+     * time, nothing is copied.
+     */
+    template<typename Source>
+    View<Source, 1> diagonal(const View<Source, 2>& arr, std::ptrdiff_t offset = 0)
+    {
+        const std::array<std::size_t, 2> shape = arr.shape();
+        const std::ptrdiff_t rows = static_cast<std::ptrdiff_t>(shape[0]);
+        const std::ptrdiff_t cols = static_cast<std::ptrdiff_t>(shape[1]);
+
+        const std::ptrdiff_t row = std::max<std::ptrdiff_t>(0, -offset);
+        const std::ptrdiff_t col = std::max<std::ptrdiff_t>(0, offset);
+        const std::ptrdiff_t length = std::max<std::ptrdiff_t>(0, std::min(rows - row, cols - col));
+
+        std::array<std::array<std::ptrdiff_t, 2>, 1> steps = {{ {{1, 1}} }};
+        std::array<std::ptrdiff_t, 2> origin = {{length > 0? row: 0, length > 0? col: 0}};
+
+        return as_strided<1>(arr, {{static_cast<std::size_t>(length)}}, steps, origin);
+    }
+
+    template<typename Dtype>
+    View<Inner<Dtype, 2>, 1> diagonal(Inner<Dtype, 2>& arr, std::ptrdiff_t offset = 0)
+    {
+        return diagonal(arr.view(), offset);
+    }
+
+    template<typename Dtype>
+    View<const Inner<Dtype, 2>, 1> diagonal(const Inner<Dtype, 2>& arr, std::ptrdiff_t offset = 0)
+    {
+        return diagonal(arr.view(), offset);
+    }
+
+    /// Sum of the diagonal `offset` of a 2D array, read through diagonal()
+    template<typename Source>
+    typename View<Source, 2>::dtype trace(const View<Source, 2>& arr, std::ptrdiff_t offset = 0)
+    {
+        const View<Source, 1> diag = diagonal(arr, offset);
+        const std::size_t n = diag.shape()[0];
+
+        typename View<Source, 2>::dtype result = typename View<Source, 2>::dtype();
+        for (std::size_t i = 0; i < n; ++i) result += diag.get({{i}});
+
+        return result;
+    }
+
+    template<typename Dtype>
+    Dtype trace(const Inner<Dtype, 2>& arr, std::ptrdiff_t offset = 0)
+    {
+        return trace(arr.view(), offset);
+    }
+
+    /**
+     * Keep the main diagonal of a 2D array, `lower` diagonals below it and
+     * `upper` diagonals above it, the rest reads as zero.
+     *
+     * @code
+     * auto tridiagonal = pp::band(matrix, 1, 1);
+     * @endcode
+     */
+    template<typename Source>
+    BandView<Source> band(const View<Source, 2>& arr, std::ptrdiff_t lower, std::ptrdiff_t upper)
+    {
+        return BandView<Source>(arr, lower, upper);
+    }
+
+    template<typename Dtype>
+    BandView<Inner<Dtype, 2>> band(Inner<Dtype, 2>& arr, std::ptrdiff_t lower, std::ptrdiff_t upper)
+    {
+        return band(arr.view(), lower, upper);
+    }
+
+    template<typename Dtype>
+    BandView<const Inner<Dtype, 2>> band(const Inner<Dtype, 2>& arr, std::ptrdiff_t lower, std::ptrdiff_t upper)
+    {
+        return band(arr.view(), lower, upper);
+    }
+
+    /// Lower triangle of a 2D array, up to the diagonal `k`, like `numpy.tril()`
+    template<typename Source>
+    BandView<Source> tril(const View<Source, 2>& arr, std::ptrdiff_t k = 0)
+    {
+        return band(arr, std::numeric_limits<std::ptrdiff_t>::max(), k);
+    }
+
+    template<typename Dtype>
+    BandView<Inner<Dtype, 2>> tril(Inner<Dtype, 2>& arr, std::ptrdiff_t k = 0)
+    {
+        return tril(arr.view(), k);
+    }
+
+    template<typename Dtype>
+    BandView<const Inner<Dtype, 2>> tril(const Inner<Dtype, 2>& arr, std::ptrdiff_t k = 0)
+    {
+        return tril(arr.view(), k);
+    }
+
+    /// Upper triangle of a 2D array, from the diagonal `k`, like `numpy.triu()`
+    template<typename Source>
+    BandView<Source> triu(const View<Source, 2>& arr, std::ptrdiff_t k = 0)
+    {
+        return band(arr, -k, std::numeric_limits<std::ptrdiff_t>::max());
+    }
+
+    template<typename Dtype>
+    BandView<Inner<Dtype, 2>> triu(Inner<Dtype, 2>& arr, std::ptrdiff_t k = 0)
+    {
+        return triu(arr.view(), k);
+    }
+
+    template<typename Dtype>
+    BandView<const Inner<Dtype, 2>> triu(const Inner<Dtype, 2>& arr, std::ptrdiff_t k = 0)
+    {
+        return triu(arr.view(), k);
+    }
+
+    /** @} */
+
+
+    /**
+     * @addtogroup expression Expressions
+     * Lazy element-wise expressions.
+     *
+     * An expression is any type with a `dtype`, an `ndim`, a `shape()` and an
+     * unchecked `get(idx)`: Inner, the views, and the nodes built by the
+     * arithmetic operators, map(), outer(), kron() and meshgrid().
+     *
+     * Operators between expressions do not compute anything, they build a
+     * tree which is evaluated in one pass, element by element, when it is
+     * copied into an Inner (assigned, or with eval()). Operands of the same
+     * dimension are broadcast along their axes of length 1, and scalars
+     * along every axis.
+     *
+     * Inner operands are kept by reference, the other operands by value.
+     * An expression must not outlive the arrays it reads.
+     *
+     * ### Example
+     * @include ndarray-expression.cpp
+     * @{
+     */
+
+    /// Check if `T` is an expression
+    template<typename T, typename = void>
+    struct is_expression : std::false_type {};
+    template<typename T>
+    struct is_expression<T, typename make_void<decltype(std::declval<const T&>().get(
+        std::declval<const std::array<std::size_t, T::ndim>&>()))>::type> : std::true_type {};  /**< @copydoc is_expression */
+
+    namespace detail
+    {
+        /// How an expression keeps its operands: arrays by reference, other expressions by value
+        template<typename T>
+        struct operand
+        {
+            using type = typename std::conditional<std::is_base_of<Inner<typename T::dtype, T::ndim>, T>::value, const T&, T>::type;
+        };
+
+        /// Write `e` into `out`, one axis at a time
+        template<typename E, std::size_t k, bool leaf = (k + 1 == E::ndim)>
+        struct Evaluate
+        {
+            template<typename Out>
+            static void run(const E& e, Out& out, const std::array<std::size_t, E::ndim>& shape, std::array<std::size_t, E::ndim>& idx, bool stream)
+            {
+                out.resize(shape[k]);
+                for (idx[k] = 0; idx[k] < shape[k]; ++idx[k])
+                    Evaluate<E, k + 1>::run(e, out.begin()[idx[k]], shape, idx, stream);
+            }
+        };
+
+        template<typename E, std::size_t k>
+        struct Evaluate<E, k, true>
+        {
+            /// Overwrite a row which already has the length of the result, or build it by appending each element once
+            template<typename Out>
+            static void run(const E& e, Out& out, const std::array<std::size_t, E::ndim>& shape, std::array<std::size_t, E::ndim>& idx, bool stream)
+            {
+                if (out.size() != shape[k])
+                {
+                    out.clear();
+                    out.reserve(shape[k]);
+                    for (idx[k] = 0; idx[k] < shape[k]; ++idx[k])
+                        out.push_back(e.get(idx));
+                    return;
+                }
+
+                if (stream && streamRow(e, out, idx, is_streamable<typename Out::value_type>())) return;
+
+                typename Out::iterator it = out.begin();
+                for (idx[k] = 0; idx[k] < shape[k]; ++idx[k], ++it)
+                    *it = e.get(idx);
+            }
+
+            /// Compute the row in chunks which stay in the cache, and stream each chunk to `out`
+            template<typename Out>
+            static bool streamRow(const E& e, Out& out, std::array<std::size_t, E::ndim>& idx, std::true_type)
+            {
+                typedef typename Out::value_type T;
+                const std::size_t chunk = 1024 / sizeof(T);
+
+                T buffer[chunk];
+                for (std::size_t first = 0; first < out.size(); first += chunk)
+                {
+                    const std::size_t n = std::min(chunk, out.size() - first);
+                    for (std::size_t j = 0; j < n; ++j)
+                    {
+                        idx[k] = first + j;
+                        buffer[j] = e.get(idx);
+                    }
+                    streamCopy(out.data() + first, buffer, n);
+                }
+                return true;
+            }
+
+            template<typename Out>
+            static bool streamRow(const E&, Out&, std::array<std::size_t, E::ndim>&, std::false_type)
+            {
+                return false;
+            }
+        };
+
+        template<typename E, typename Dtype>
+        void evaluate(const E& e, Inner<Dtype, E::ndim>& out)
+        {
+            const std::array<std::size_t, E::ndim> shape = e.shape();
+            const bool stream = streaming<Dtype>(product(shape));
+
+            std::array<std::size_t, E::ndim> idx = {};
+            Evaluate<E, 0>::run(e, out, shape, idx, stream);
+            if (stream) streamFence();
+        }
+
+        /// Shape of broadcasting `a` against `b`
+        template<std::size_t dim>
+        std::array<std::size_t, dim> broadcast(const std::array<std::size_t, dim>& a, const std::array<std::size_t, dim>& b)
+        {
+            std::array<std::size_t, dim> result;
+            for (std::size_t k = 0; k < dim; ++k)
+            {
+                if (a[k] != b[k] && a[k] != 1 && b[k] != 1) detail::raise<std::invalid_argument>("Shapes cannot be broadcast together");
+                result[k] = (a[k] == 1)? b[k]: a[k];
+            }
+            return result;
+        }
+
+        /// Index into an operand of shape `shape`, which may be broadcast
+        template<std::size_t dim>
+        std::array<std::size_t, dim> broadcastIndex(std::array<std::size_t, dim> idx, const std::array<std::size_t, dim>& shape)
+        {
+            for (std::size_t k = 0; k < dim; ++k)
+                if (shape[k] == 1) idx[k] = 0;
+            return idx;
+        }
+
+        struct Plus       { template<typename A, typename B> auto operator()(const A& a, const B& b) const -> decltype(a + b) { return a + b; } };
+        struct Minus      { template<typename A, typename B> auto operator()(const A& a, const B& b) const -> decltype(a - b) { return a - b; } };
+        struct Multiplies { template<typename A, typename B> auto operator()(const A& a, const B& b) const -> decltype(a * b) { return a * b; } };
+        struct Divides    { template<typename A, typename B> auto operator()(const A& a, const B& b) const -> decltype(a / b) { return a / b; } };
+        struct Negate     { template<typename A> auto operator()(const A& a) const -> decltype(-a) { return -a; } };
+    }
+
+    /// Common methods of the expression nodes, materializing `Derived`
+    template<typename Derived, typename Dtype, std::size_t dim>
+    struct Expression
+    {
+        /// Evaluate the expression into a new Inner
+        Inner<Dtype, dim> copy() const
+        {
+            Inner<Dtype, dim> result;
+            detail::evaluate(static_cast<const Derived&>(*this), result);
+            return result;
+        }
+
+        /// Evaluate when assigned to an Inner
+        operator Inner<Dtype, dim>() const
+        {
+            return copy();
+        }
+
+        std::string toString(int indentLevel = 0) const
+        {
+            return copy().toString(indentLevel);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const Expression& expr)
+        {
+            return os << expr.toString();
+        }
+    };
+
+    /// A scalar, broadcast along every axis
+    template<typename T, std::size_t dim>
+    struct Scalar : Expression<Scalar<T, dim>, T, dim>
+    {
+        using dtype = T;
+        static constexpr std::size_t ndim = dim;
+
+        explicit Scalar(const T& value) : value_(value) {}
+
+        std::array<std::size_t, dim> shape() const
+        {
+            std::array<std::size_t, dim> result;
+            result.fill(1);
+            return result;
+        }
+
+        T get(const std::array<std::size_t, dim>&) const { return value_; }
+
+    private:
+        T value_;
+    };
+
+    /// `op` applied to each element of `A`
+    template<typename Op, typename A>
+    struct UnaryExpr : Expression<UnaryExpr<Op, A>,
+                                  typename std::decay<decltype(std::declval<const Op&>()(std::declval<typename A::dtype>()))>::type,
+                                  A::ndim>
+    {
+        using dtype = typename std::decay<decltype(std::declval<const Op&>()(std::declval<typename A::dtype>()))>::type;
+        static constexpr std::size_t ndim = A::ndim;
+
+        UnaryExpr(const Op& op, const A& a) : op_(op), a_(a) {}
+
+        std::array<std::size_t, ndim> shape() const { return a_.shape(); }
+
+        dtype get(const std::array<std::size_t, ndim>& idx) const { return op_(a_.get(idx)); }
+
+    private:
+        Op op_;
+        typename detail::operand<A>::type a_;
+    };
+
+    /// `op` applied to each pair of elements of `A` and `B`, broadcast together
+    template<typename Op, typename A, typename B>
+    struct BinaryExpr : Expression<BinaryExpr<Op, A, B>,
+                                   typename std::decay<decltype(std::declval<const Op&>()(std::declval<typename A::dtype>(), std::declval<typename B::dtype>()))>::type,
+                                   A::ndim>
+    {
+        static_assert(A::ndim == B::ndim, "Operands must have the same dimension, use pp::newaxis to add axes");
+
+        using dtype = typename std::decay<decltype(std::declval<const Op&>()(std::declval<typename A::dtype>(), std::declval<typename B::dtype>()))>::type;
+        static constexpr std::size_t ndim = A::ndim;
+
+        /// @throw std::invalid_argument if the shapes cannot be broadcast together
+        BinaryExpr(const Op& op, const A& a, const B& b) : op_(op), a_(a), b_(b), shapeA_(a.shape()), shapeB_(b.shape()),
+                                                           shape_(detail::broadcast(shapeA_, shapeB_))
+        {}
+
+        std::array<std::size_t, ndim> shape() const { return shape_; }
+
+        dtype get(const std::array<std::size_t, ndim>& idx) const
+        {
+            return op_(a_.get(detail::broadcastIndex(idx, shapeA_)), b_.get(detail::broadcastIndex(idx, shapeB_)));
+        }
+
+    private:
+        Op op_;
+        typename detail::operand<A>::type a_;
+        typename detail::operand<B>::type b_;
+        std::array<std::size_t, ndim> shapeA_, shapeB_, shape_;
+    };
+
+    /// A 1D expression repeated along the other axes of a `dim` dimensional shape
+    template<typename A, std::size_t dim>
+    struct AxisBroadcast : Expression<AxisBroadcast<A, dim>, typename A::dtype, dim>
+    {
+        static_assert(A::ndim == 1, "Only 1D expressions can be broadcast along an axis");
+
+        using dtype = typename A::dtype;
+        static constexpr std::size_t ndim = dim;
+
+        /// `a` goes along `axis` of `shape`, whose length on that axis must be the length of `a`
+        AxisBroadcast(const A& a, const std::array<std::size_t, dim>& shape, std::size_t axis) : a_(a), shape_(shape), axis_(axis)
+        {}
+
+        std::array<std::size_t, dim> shape() const { return shape_; }
+
+        dtype get(const std::array<std::size_t, dim>& idx) const
+        {
+            return a_.get({{idx[axis_]}});
+        }
+
+    private:
+        typename detail::operand<A>::type a_;
+        std::array<std::size_t, dim> shape_;
+        std::size_t axis_;
+    };
+
+    /// Kronecker product of two 1D expressions, see kron()
+    template<typename A, typename B>
+    struct Kron : Expression<Kron<A, B>, decltype(std::declval<typename A::dtype>() * std::declval<typename B::dtype>()), 1>
+    {
+        static_assert(A::ndim == 1 && B::ndim == 1, "kron() takes 1D expressions");
+
+        using dtype = decltype(std::declval<typename A::dtype>() * std::declval<typename B::dtype>());
+        static constexpr std::size_t ndim = 1;
+
+        Kron(const A& a, const B& b) : a_(a), b_(b), n_(a.shape()[0]), m_(b.shape()[0])
+        {}
+
+        std::array<std::size_t, 1> shape() const { return {{n_ * m_}}; }
+
+        dtype get(const std::array<std::size_t, 1>& idx) const
+        {
+            return a_.get({{idx[0] / m_}}) * b_.get({{idx[0] % m_}});
+        }
+
+    private:
+        typename detail::operand<A>::type a_;
+        typename detail::operand<B>::type b_;
+        std::size_t n_, m_;
+    };
+
+    /**
+     * An array computed from the index of each element, see arange(), linspace() and full().
+     *
+     * Only the shape and `f` are stored, elements are computed when they are read.
+     * `F` is called with the index, as a `std::array<std::size_t, dim>`.
+     *
+     * Generators can be used in expressions and views like an Inner, as long
+     * as they outlive them.
+     */
+    template<typename F, std::size_t dim>
+    struct Generator : Expression<Generator<F, dim>,
+                                  typename std::decay<decltype(std::declval<const F&>()(std::declval<const std::array<std::size_t, dim>&>()))>::type,
+                                  dim>
+    {
+        using dtype = typename std::decay<decltype(std::declval<const F&>()(std::declval<const std::array<std::size_t, dim>&>()))>::type;
+        static constexpr std::size_t ndim = dim;
+
+        Generator(const F& f, const std::array<std::size_t, dim>& shape) : f_(f), shape_(shape)
+        {}
+
+        std::array<std::size_t, dim> shape() const { return shape_; }
+
+        dtype get(const std::array<std::size_t, dim>& idx) const { return f_(idx); }
+
+        /// Element at the `dim` indices pointed by `idx`, so that a View can read it
+        dtype element(const std::ptrdiff_t* idx) const
+        {
+            std::array<std::size_t, dim> pos;
+            std::copy(idx, idx + dim, pos.begin());
+            return f_(pos);
+        }
+
+        /// View of the generator, e.g. to add axes with pp::newaxis
+        template<typename... Args,
+                 typename std::enable_if<conjunction<is_slice_arg<Args>...>::value, int>::type = 0>
+        View<const Generator, slice_rank<dim, Args...>::value> view(const Args&... args) const
+        {
+            return View<const Generator, dim>(*this).view(args...);
+        }
+
+        /// Indexing, with negative indices counting from the end
+        template<typename... Indices,
+                 typename std::enable_if<sizeof...(Indices) == dim, int>::type = 0,
+                 typename std::enable_if<conjunction<std::is_integral<Indices>...>::value, int>::type = 0>
+        dtype operator()(Indices... indices) const
+        {
+            const std::ptrdiff_t idx[] = {static_cast<std::ptrdiff_t>(indices)...};
+
+            std::array<std::size_t, dim> pos;
+            for (std::size_t k = 0; k < dim; ++k)
+            {
+                std::ptrdiff_t i = idx[k];
+                if (i < 0) i += shape_[k];
+                if (i < 0 || i >= static_cast<std::ptrdiff_t>(shape_[k])) detail::raise<std::out_of_range>("Index out of range");
+                pos[k] = static_cast<std::size_t>(i);
+            }
+
+            return f_(pos);
+        }
+
+    private:
+        F f_;
+        std::array<std::size_t, dim> shape_;
+    };
+
+    namespace detail
+    {
+        /// `start + i * step`
+        template<typename T>
+        struct Ramp
+        {
+            T start, step;
+            T operator()(const std::array<std::size_t, 1>& idx) const { return static_cast<T>(start + static_cast<T>(idx[0]) * step); }
+        };
+
+        /// `start + i * (stop - start) / (num - 1)`, exactly `stop` at the end
+        template<typename T>
+        struct Linear
+        {
+            T start, stop;
+            std::size_t num;
+            T operator()(const std::array<std::size_t, 1>& idx) const
+            {
+                if (idx[0] == 0) return start;
+                if (idx[0] + 1 == num) return stop;
+                return static_cast<T>(start + (stop - start) * static_cast<T>(idx[0]) / static_cast<T>(num - 1));
+            }
+        };
+
+        /// The same value everywhere
+        template<typename T, std::size_t dim>
+        struct Constant
+        {
+            T value;
+            T operator()(const std::array<std::size_t, dim>&) const { return value; }
+        };
+    }
+
+    template<typename T, std::size_t dim> constexpr std::size_t Scalar<T, dim>::ndim;
+    template<typename F, std::size_t dim> constexpr std::size_t Generator<F, dim>::ndim;
+    template<typename Op, typename A> constexpr std::size_t UnaryExpr<Op, A>::ndim;
+    template<typename Op, typename A, typename B> constexpr std::size_t BinaryExpr<Op, A, B>::ndim;
+    template<typename A, std::size_t dim> constexpr std::size_t AxisBroadcast<A, dim>::ndim;
+    template<typename A, typename B> constexpr std::size_t Kron<A, B>::ndim;
+
+    /**
+     * Virtual 1D array from `start` (inclusive) to `stop` (exclusive) by `step`, like `numpy.arange()`.
+     *
+     * Nothing is stored, each element is computed when it is read.
+     *
+     * @throw std::invalid_argument if `step` is zero
+     */
+    template<typename T>
+    Generator<detail::Ramp<T>, 1> arange(T start, T stop, T step = T(1))
+    {
+        if (step == T(0)) detail::raise<std::invalid_argument>("Step cannot be zero");
+
+        // In double, so that stop < start gives no element for unsigned types too
+        const double count = std::ceil((static_cast<double>(stop) - static_cast<double>(start)) / static_cast<double>(step));
+        const std::size_t n = count > 0? static_cast<std::size_t>(count): 0;
+
+        detail::Ramp<T> ramp = {start, step};
+        return Generator<detail::Ramp<T>, 1>(ramp, {{n}});
+    }
+
+    /// Virtual 1D array from 0 (inclusive) to `stop` (exclusive)
+    template<typename T>
+    Generator<detail::Ramp<T>, 1> arange(T stop)
+    {
+        return arange(T(0), stop, T(1));
+    }
+
+    /// Virtual 1D array of `num` evenly spaced values from `start` to `stop` (both inclusive), like `numpy.linspace()`
+    template<typename T>
+    Generator<detail::Linear<T>, 1> linspace(T start, T stop, std::size_t num = 50)
+    {
+        detail::Linear<T> linear = {start, stop, num};
+        return Generator<detail::Linear<T>, 1>(linear, {{num}});
+    }
+
+    /// Virtual array of shape `shape` filled with `value`, nothing is stored
+    template<typename T, std::size_t dim>
+    Generator<detail::Constant<T, dim>, dim> full(const std::array<std::size_t, dim>& shape, const T& value)
+    {
+        detail::Constant<T, dim> constant = {value};
+        return Generator<detail::Constant<T, dim>, dim>(constant, shape);
+    }
+
+    /// Virtual array of shape `shape` filled with zeros
+    template<typename T, std::size_t dim>
+    Generator<detail::Constant<T, dim>, dim> zeros(const std::array<std::size_t, dim>& shape)
+    {
+        return full(shape, T(0));
+    }
+
+    /// Virtual array of shape `shape` filled with ones
+    template<typename T, std::size_t dim>
+    Generator<detail::Constant<T, dim>, dim> ones(const std::array<std::size_t, dim>& shape)
+    {
+        return full(shape, T(1));
+    }
+
+    /// Virtual array of shape `shape` whose elements are `f(idx)`
+    template<typename F, std::size_t dim>
+    Generator<F, dim> fromfunction(const F& f, const std::array<std::size_t, dim>& shape)
+    {
+        return Generator<F, dim>(f, shape);
+    }
+
+    /// Evaluate an expression into a new Inner
+    template<typename E, typename std::enable_if<is_expression<E>::value, int>::type = 0>
+    Inner<typename E::dtype, E::ndim> eval(const E& e)
+    {
+        detail::OpTimer timer;
+        Inner<typename E::dtype, E::ndim> result;
+        detail::evaluate(e, result);
+        timer.done<typename E::dtype>("eval", e);
+        return result;
+    }
+
+    namespace detail
+    {
+        template<typename E, typename T, std::size_t dim>
+        void assign(const E& e, Inner<T, dim>& out)
+        {
+            evaluate(e, out);
+        }
+
+        /// Views copy whole rows when they can
+        template<typename Source, std::size_t dim, typename T>
+        void assign(const View<Source, dim>& v, Inner<T, dim>& out)
+        {
+            v.copy(out);
+        }
+
+        template<typename Source, std::size_t dim, typename T>
+        void assign(const RollView<Source, dim>& v, Inner<T, dim>& out)
+        {
+            v.copy(out);
+        }
+    }
+
+    /**
+     * Evaluate an expression (or copy a view) into `out`, which keeps its storage.
+     *
+     * Reusing the same `out` in a loop does not allocate.
+     *
+     * @throws std::invalid_argument if the shape of `out` differs.
+     */
+    template<typename E, typename std::enable_if<is_expression<E>::value, int>::type = 0>
+    void eval(const E& e, Inner<typename E::dtype, E::ndim>& out)
+    {
+        detail::OpTimer timer;
+        detail::checkShape(out.shape(), e.shape());
+        detail::assign(e, out);
+        timer.done<typename E::dtype>("eval", e);
+    }
+
+    /// Lazily apply `f` to each element of `a`
+    template<typename F, typename A, typename std::enable_if<is_expression<A>::value, int>::type = 0>
+    UnaryExpr<F, A> map(const F& f, const A& a)
+    {
+        return UnaryExpr<F, A>(f, a);
+    }
+
+    /// Lazily apply `f` to each pair of elements of `a` and `b`, broadcast together
+    template<typename F, typename A, typename B,
+             typename std::enable_if<is_expression<A>::value && is_expression<B>::value, int>::type = 0>
+    BinaryExpr<F, A, B> map(const F& f, const A& a, const B& b)
+    {
+        return BinaryExpr<F, A, B>(f, a, b);
+    }
+
+    template<typename A, typename std::enable_if<is_expression<A>::value, int>::type = 0>
+    UnaryExpr<detail::Negate, A> operator-(const A& a)
+    {
+        return UnaryExpr<detail::Negate, A>(detail::Negate(), a);
+    }
+
+#define PP_NDARRAY_BINARY_OPERATOR(op, Functor)                                                                     \
+    template<typename A, typename B,                                                                                \
+             typename std::enable_if<is_expression<A>::value && is_expression<B>::value, int>::type = 0>            \
+    BinaryExpr<detail::Functor, A, B> operator op(const A& a, const B& b)                                           \
+    {                                                                                                               \
+        return BinaryExpr<detail::Functor, A, B>(detail::Functor(), a, b);                                          \
+    }                                                                                                               \
+    template<typename A, typename S,                                                                                \
+             typename std::enable_if<is_expression<A>::value && std::is_arithmetic<S>::value, int>::type = 0>       \
+    BinaryExpr<detail::Functor, A, Scalar<S, A::ndim>> operator op(const A& a, const S& s)                          \
+    {                                                                                                               \
+        return BinaryExpr<detail::Functor, A, Scalar<S, A::ndim>>(detail::Functor(), a, Scalar<S, A::ndim>(s));     \
+    }                                                                                                               \
+    template<typename S, typename B,                                                                                \
+             typename std::enable_if<std::is_arithmetic<S>::value && is_expression<B>::value, int>::type = 0>       \
+    BinaryExpr<detail::Functor, Scalar<S, B::ndim>, B> operator op(const S& s, const B& b)                          \
+    {                                                                                                               \
+        return BinaryExpr<detail::Functor, Scalar<S, B::ndim>, B>(detail::Functor(), Scalar<S, B::ndim>(s), b);     \
+    }
+
+    PP_NDARRAY_BINARY_OPERATOR(+, Plus)
+    PP_NDARRAY_BINARY_OPERATOR(-, Minus)
+    PP_NDARRAY_BINARY_OPERATOR(*, Multiplies)
+    PP_NDARRAY_BINARY_OPERATOR(/, Divides)
+
+#undef PP_NDARRAY_BINARY_OPERATOR
+
+    /**
+     * Lazy outer product of two 1D expressions, `result(i, j) == a(i) * b(j)`.
+     *
+     * Nothing is computed until the result is evaluated, so it can be fused
+     * with the operations which follow it.
+     */
+    template<typename A, typename B,
+             typename std::enable_if<is_expression<A>::value && is_expression<B>::value, int>::type = 0>
+    BinaryExpr<detail::Multiplies, AxisBroadcast<A, 2>, AxisBroadcast<B, 2>> outer(const A& a, const B& b)
+    {
+        const std::array<std::size_t, 2> shape = {{a.shape()[0], b.shape()[0]}};
+        return BinaryExpr<detail::Multiplies, AxisBroadcast<A, 2>, AxisBroadcast<B, 2>>(
+            detail::Multiplies(), AxisBroadcast<A, 2>(a, shape, 0), AxisBroadcast<B, 2>(b, shape, 1));
+    }
+
+    /// Lazy Kronecker product of two 1D expressions, `result(i * len(b) + j) == a(i) * b(j)`
+    template<typename A, typename B,
+             typename std::enable_if<is_expression<A>::value && is_expression<B>::value, int>::type = 0>
+    Kron<A, B> kron(const A& a, const B& b)
+    {
+        return Kron<A, B>(a, b);
+    }
+
+    /**
+     * Lazy coordinate grids of two 1D expressions, like `numpy.meshgrid(x, y)`.
+     *
+     * Both grids have `len(y)` rows and `len(x)` columns: in the first one
+     * each row is `x`, in the second one each column is `y`. Neither of them
+     * is stored.
+     */
+    template<typename X, typename Y,
+             typename std::enable_if<is_expression<X>::value && is_expression<Y>::value, int>::type = 0>
+    std::pair<AxisBroadcast<X, 2>, AxisBroadcast<Y, 2>> meshgrid(const X& x, const Y& y)
+    {
+        const std::array<std::size_t, 2> shape = {{y.shape()[0], x.shape()[0]}};
+        return std::make_pair(AxisBroadcast<X, 2>(x, shape, 1), AxisBroadcast<Y, 2>(y, shape, 0));
+    }
+
+    /** @} */
+
+
+    /**
+     * @addtogroup searching Searching
+     * Find the nonzero elements of an Inner.
+     *
+     * The elements are scanned one row (last axis) at a time, in two passes:
+     * the first one counts the nonzero elements of each row, which gives the
+     * size of the result and the offset of each row in it, and the second one
+     * writes the indices of each row directly at its offset. With AVX-512,
+     * rows of 32 and 64 bit elements are compared 16 or 8 at a time and the
+     * indices are written with compress stores.
+     * @{
+     */
+
+    namespace detail
+    {
+        /// Call `f(row, r)` for each row of `arr`, `r` counting rows in row-major order
+        template<typename T, typename F>
+        void forEachRow(const Inner<T, 1>& arr, F& f, std::size_t& r)
+        {
+            f(arr, r++);
+        }
+
+        template<typename T, std::size_t dim, typename F>
+        void forEachRow(const Inner<T, dim>& arr, F& f, std::size_t& r)
+        {
+            for (typename Inner<T, dim>::const_iterator it = arr.begin(); it != arr.end(); ++it)
+                forEachRow(*it, f, r);
+        }
+
+        template<typename T, std::size_t dim, typename F>
+        void forEachRow(const Inner<T, dim>& arr, F& f)
+        {
+            std::size_t r = 0;
+            forEachRow(arr, f, r);
+        }
+
+        inline std::size_t popcount(std::uint32_t x)
+        {
+            x = x - ((x >> 1) & 0x55555555u);
+            x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+            return (((x + (x >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+        }
+
+        /// Number of nonzero elements in `[first, first + n)`
+        template<typename T>
+        std::size_t countNonzero(const T* first, std::size_t n)
+        {
+            std::size_t count = 0;
+            for (std::size_t j = 0; j < n; ++j) count += (first[j] != T(0));
+            return count;
+        }
+
+        /// Write the positions of the nonzero elements of `[first, first + n)` to `out`
+        template<typename T>
+        void compressNonzero(const T* first, std::size_t n, std::size_t* out)
+        {
+            for (std::size_t j = 0; j < n; ++j)
+                if (first[j] != T(0)) *out++ = j;
+        }
+
+#if defined(PP_NDARRAY_AVX512)
+        /// Compress the positions `base` to `base + 15` selected by `mask`, returns the past the end of `out`
+        inline std::size_t* compressPositions16(__mmask16 mask, std::size_t base, std::size_t* out)
+        {
+            const __m512i lanes = _mm512_add_epi64(_mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0), _mm512_set1_epi64(static_cast<long long>(base)));
+            const __mmask8 lo = static_cast<__mmask8>(mask), hi = static_cast<__mmask8>(mask >> 8);
+
+            _mm512_mask_compressstoreu_epi64(out, lo, lanes);
+            out += popcount(lo);
+            _mm512_mask_compressstoreu_epi64(out, hi, _mm512_add_epi64(lanes, _mm512_set1_epi64(8)));
+            return out + popcount(hi);
+        }
+
+        inline __mmask16 nonzeroMask(const std::int32_t* p)  { __m512i v = _mm512_loadu_si512(p); return _mm512_test_epi32_mask(v, v); }
+        inline __mmask16 nonzeroMask(const std::uint32_t* p) { __m512i v = _mm512_loadu_si512(p); return _mm512_test_epi32_mask(v, v); }
+        inline __mmask16 nonzeroMask(const float* p)         { return _mm512_cmp_ps_mask(_mm512_loadu_ps(p), _mm512_setzero_ps(), _CMP_NEQ_UQ); }
+        inline __mmask8 nonzeroMask(const std::int64_t* p)   { __m512i v = _mm512_loadu_si512(p); return _mm512_test_epi64_mask(v, v); }
+        inline __mmask8 nonzeroMask(const std::uint64_t* p)  { __m512i v = _mm512_loadu_si512(p); return _mm512_test_epi64_mask(v, v); }
+        inline __mmask8 nonzeroMask(const double* p)         { return _mm512_cmp_pd_mask(_mm512_loadu_pd(p), _mm512_setzero_pd(), _CMP_NEQ_UQ); }
+
+        template<typename T>
+        std::size_t countNonzeroSimd(const T* first, std::size_t n)
+        {
+            const std::size_t lanes = 64 / sizeof(T);
+
+            std::size_t count = 0, j = 0;
+            for (; j + lanes <= n; j += lanes) count += popcount(nonzeroMask(first + j));
+            for (; j < n; ++j) count += (first[j] != T(0));
+            return count;
+        }
+
+        template<typename T>
+        void compressNonzeroSimd(const T* first, std::size_t n, std::size_t* out)
+        {
+            const std::size_t lanes = 64 / sizeof(T);
+            std::size_t j = 0;
+            for (; j + lanes <= n; j += lanes)
+            {
+                if (lanes == 16)
+                {
+                    out = compressPositions16(static_cast<__mmask16>(nonzeroMask(first + j)), j, out);
+                }
+                else
+                {
+                    const __mmask8 mask = static_cast<__mmask8>(nonzeroMask(first + j));
+                    const __m512i positions = _mm512_add_epi64(_mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0), _mm512_set1_epi64(static_cast<long long>(j)));
+                    _mm512_mask_compressstoreu_epi64(out, mask, positions);
+                    out += popcount(mask);
+                }
+            }
+
+            for (; j < n; ++j)
+                if (first[j] != T(0)) *out++ = j;
+        }
+
+        template<> inline std::size_t countNonzero(const std::int32_t* p, std::size_t n)  { return countNonzeroSimd(p, n); }
+        template<> inline std::size_t countNonzero(const std::uint32_t* p, std::size_t n) { return countNonzeroSimd(p, n); }
+        template<> inline std::size_t countNonzero(const float* p, std::size_t n)         { return countNonzeroSimd(p, n); }
+        template<> inline std::size_t countNonzero(const std::int64_t* p, std::size_t n)  { return countNonzeroSimd(p, n); }
+        template<> inline std::size_t countNonzero(const std::uint64_t* p, std::size_t n) { return countNonzeroSimd(p, n); }
+        template<> inline std::size_t countNonzero(const double* p, std::size_t n)        { return countNonzeroSimd(p, n); }
+
+        template<> inline void compressNonzero(const std::int32_t* p, std::size_t n, std::size_t* out)  { compressNonzeroSimd(p, n, out); }
+        template<> inline void compressNonzero(const std::uint32_t* p, std::size_t n, std::size_t* out) { compressNonzeroSimd(p, n, out); }
+        template<> inline void compressNonzero(const float* p, std::size_t n, std::size_t* out)         { compressNonzeroSimd(p, n, out); }
+        template<> inline void compressNonzero(const std::int64_t* p, std::size_t n, std::size_t* out)  { compressNonzeroSimd(p, n, out); }
+        template<> inline void compressNonzero(const std::uint64_t* p, std::size_t n, std::size_t* out) { compressNonzeroSimd(p, n, out); }
+        template<> inline void compressNonzero(const double* p, std::size_t n, std::size_t* out)        { compressNonzeroSimd(p, n, out); }
+#endif
+
+        /// Rows of std::vector<bool> are not stored as an array of bool
+        inline std::size_t countNonzero(const Inner<bool, 1>& row)
+        {
+            return static_cast<std::size_t>(std::count(row.begin(), row.end(), true));
+        }
+
+        inline void compressNonzero(const Inner<bool, 1>& row, std::size_t* out)
+        {
+            for (std::size_t j = 0; j < row.size(); ++j)
+                if (row.begin()[j]) *out++ = j;
+        }
+
+        template<typename T>
+        std::size_t countNonzero(const Inner<T, 1>& row)
+        {
+            return countNonzero(row.data(), row.size());
+        }
+
+        template<typename T>
+        void compressNonzero(const Inner<T, 1>& row, std::size_t* out)
+        {
+            compressNonzero(row.data(), row.size(), out);
+        }
+
+        /// First pass: number of nonzero elements of each row
+        struct CountRows
+        {
+            std::size_t* counts;
+
+            template<typename T>
+            void operator()(const Inner<T, 1>& row, std::size_t r) { counts[r] = countNonzero(row); }
+        };
+
+        /// Second pass: indices of the nonzero elements of each row, at the offset of the row
+        template<std::size_t dim>
+        struct CompressRows
+        {
+            const std::size_t* offsets;
+            const std::array<std::size_t, dim>& shape;
+            std::array<Inner<std::size_t, 1>, dim>& out;
+
+            template<typename T>
+            void operator()(const Inner<T, 1>& row, std::size_t r)
+            {
+                const std::size_t first = offsets[r], count = offsets[r + 1] - offsets[r];
+                if (count == 0) return;
+
+                compressNonzero(row, out[dim - 1].data() + first);
+
+                // Indices of the row along the other axes
+                for (std::size_t k = dim - 1; k-- > 0; r /= shape[k])
+                    std::fill_n(out[k].begin() + first, count, r % shape[k]);
+            }
+        };
+    }
+
+    /// Number of nonzero elements of `arr`
+    template<typename T, std::size_t dim>
+    std::size_t count_nonzero(const Inner<T, dim>& arr)
+    {
+        struct Sum
+        {
+            std::size_t total;
+            void operator()(const Inner<T, 1>& row, std::size_t) { total += detail::countNonzero(row); }
+        } sum = {0};
+
+        detail::OpTimer timer;
+        detail::forEachRow(arr, sum);
+        timer.done<T>("count_nonzero", arr);
+        return sum.total;
+    }
+
+    /**
+     * Indices of the nonzero elements of `arr`, one array per axis, like `numpy.nonzero()`.
+     *
+     * The indices are in row-major order: the `i`-th nonzero element is at
+     * `(result[0][i], result[1][i], ...)`.
+     *
+     * @param workspace Holds the count of each row.
+     */
+    template<typename T, std::size_t dim>
+    std::array<Inner<std::size_t, 1>, dim> nonzero(const Inner<T, dim>& arr, Workspace& workspace = Workspace::local())
+    {
+        detail::OpTimer timer;
+        const std::array<std::size_t, dim> shape = arr.shape();
+        std::size_t rows = 1;
+        for (std::size_t k = 0; k + 1 < dim; ++k) rows *= shape[k];
+
+        Workspace::Scope scope(workspace);
+        std::size_t* offsets = workspace.allocate<std::size_t>(rows + 1);
+
+        // Row r is counted in offsets[r + 1], the prefix sum turns offsets[r] into where row r starts
+        offsets[0] = 0;
+        detail::CountRows count = {offsets + 1};
+        detail::forEachRow(arr, count);
+        for (std::size_t r = 1; r <= rows; ++r) offsets[r] += offsets[r - 1];
+
+        std::array<Inner<std::size_t, 1>, dim> result;
+        for (std::size_t k = 0; k < dim; ++k) result[k].resize(offsets[rows]);
+
+        detail::CompressRows<dim> compress = {offsets, shape, result};
+        detail::forEachRow(arr, compress);
+
+        timer.done<T>("nonzero", arr);
+        return result;
+    }
+
+    /// Indices of the nonzero elements of `arr`, one row per element, like `numpy.argwhere()`
+    template<typename T, std::size_t dim>
+    Inner<std::size_t, 2> argwhere(const Inner<T, dim>& arr, Workspace& workspace = Workspace::local())
+    {
+        detail::OpTimer timer;
+        const std::array<Inner<std::size_t, 1>, dim> indices = nonzero(arr, workspace);
+        const std::size_t n = indices[0].size();
+
+        Inner<std::size_t, 2> result(n, dim);
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t k = 0; k < dim; ++k)
+                result.begin()[i].begin()[k] = indices[k].begin()[i];
+
+        timer.done<T>("argwhere", arr);
+        return result;
+    }
+
+    /** @} */
+
+
+    /**
+     * @addtogroup indexing Indexing routines
+     * Select elements by position.
+     * @{
+     */
+
+    namespace detail
+    {
+        /// Gather `row[indices[j]]`, prefetching the elements `distance` indices ahead
+        template<typename T>
+        void gather(const Inner<T, 1>& row, const Inner<std::size_t, 1>& indices, Inner<T, 1>& out, std::size_t distance)
+        {
+            out.resize(indices.size());
+            const std::size_t n = indices.size(), ahead = distance < n ? n - distance : 0;
+
+            std::size_t j = 0;
+            if (distance != 0)
+                for (; j < ahead; ++j)
+                {
+                    prefetch(&row.data()[indices.data()[j + distance]]);
+                    out.data()[j] = row.data()[indices.data()[j]];
+                }
+            for (; j < n; ++j) out.data()[j] = row.data()[indices.data()[j]];
+        }
+
+        inline void gather(const Inner<bool, 1>& row, const Inner<std::size_t, 1>& indices, Inner<bool, 1>& out, std::size_t)
+        {
+            out.resize(indices.size());
+            for (std::size_t j = 0; j < indices.size(); ++j) out.begin()[j] = row.begin()[indices.data()[j]];
+        }
+
+        /// Gather the sub-arrays `arr[indices[j]]`, prefetching the rows of the one `distance` indices ahead
+        template<typename T, std::size_t dim>
+        void gather(const Inner<T, dim>& arr, const Inner<std::size_t, 1>& indices, Inner<T, dim>& out, std::size_t distance)
+        {
+            out.resize(indices.size());
+            for (std::size_t j = 0; j < indices.size(); ++j)
+            {
+                if (distance != 0 && j + distance < indices.size()) prefetchRows(arr.begin()[indices.data()[j + distance]]);
+                out.begin()[j] = arr.begin()[indices.data()[j]];
+            }
+        }
+
+        template<typename T>
+        void take(const Inner<T, 1>& arr, const Inner<std::size_t, 1>& indices, std::size_t, Inner<T, 1>& out, std::size_t distance)
+        {
+            gather(arr, indices, out, distance);
+        }
+
+        template<typename T, std::size_t dim>
+        void take(const Inner<T, dim>& arr, const Inner<std::size_t, 1>& indices, std::size_t axis, Inner<T, dim>& out, std::size_t distance)
+        {
+            if (axis == 0)
+            {
+                gather(arr, indices, out, distance);
+                return;
+            }
+
+            out.resize(arr.size());
+            for (std::size_t i = 0; i < arr.size(); ++i)
+                take(arr.begin()[i], indices, axis - 1, out.begin()[i], distance);
+        }
+    }
+
+    /**
+     * Elements of `arr` at `indices` along `axis`, like `numpy.take()`.
+     *
+     * @throws std::out_of_range if `axis` or an index is out of range.
+     */
+    template<typename T, std::size_t dim>
+    Inner<T, dim> take(const Inner<T, dim>& arr, const Inner<std::size_t, 1>& indices, std::size_t axis = 0)
+    {
+        detail::OpTimer timer;
+        if (axis >= dim) detail::raise<std::out_of_range>("Axis out of range");
+
+        const std::size_t size = arr.shape()[axis];
+        for (std::size_t j = 0; j < indices.size(); ++j)
+            if (indices.data()[j] >= size) detail::raise<std::out_of_range>("Index out of range");
+
+        detail::InheritTag tag(detail::tagOf(arr, 0));
+        Inner<T, dim> result;
+        detail::take(arr, indices, axis, result, prefetch_distance());
+        timer.done<T>("take", arr, indices, result);
+        return result;
+    }
+
+    /**
+     * take() into `out`, which keeps its storage.
+     *
+     * @throws std::out_of_range if `axis` or an index is out of range.
+     * @throws std::invalid_argument if the shape of `out` differs.
+     */
+    template<typename T, std::size_t dim>
+    void take(const Inner<T, dim>& arr, const Inner<std::size_t, 1>& indices, std::size_t axis, Inner<T, dim>& out)
+    {
+        detail::OpTimer timer;
+        if (axis >= dim) detail::raise<std::out_of_range>("Axis out of range");
+
+        std::array<std::size_t, dim> shape = arr.shape();
+        for (std::size_t j = 0; j < indices.size(); ++j)
+            if (indices.data()[j] >= shape[axis]) detail::raise<std::out_of_range>("Index out of range");
+
+        shape[axis] = indices.size();
+        detail::checkShape(out.shape(), shape);
+        detail::take(arr, indices, axis, out, prefetch_distance());
+        timer.done<T>("take", arr, indices, out);
+    }
+
+    /** @} */
+
+
+    /**
+     * @addtogroup reduction Reductions
+     * Reduce an Inner over all its elements or along an axis.
+     * @{
+     */
+
+    namespace detail
+    {
+        template<typename T>
+        void accumulate(Inner<T, 1>& out, const Inner<T, 1>& row)
+        {
+            for (std::size_t j = 0; j < row.size(); ++j) out.begin()[j] += row.begin()[j];
+        }
+
+        template<typename T, std::size_t dim>
+        void accumulate(Inner<T, dim>& out, const Inner<T, dim>& arr)
+        {
+            for (std::size_t i = 0; i < arr.size(); ++i) accumulate(out.begin()[i], arr.begin()[i]);
+        }
+
+        /// Sum of `[first, first + n)`
+        template<typename T>
+        T sum(const T* first, std::size_t n)
+        {
+            T total = T();
+            for (std::size_t j = 0; j < n; ++j) total += first[j];
+            return total;
+        }
+
+        template<typename T>
+        T sum(const Inner<T, 1>& row)
+        {
+            return sum(row.data(), row.size());
+        }
+
+        inline bool sum(const Inner<bool, 1>& row)
+        {
+            bool total = false;
+            for (std::size_t j = 0; j < row.size(); ++j) total = total || row.begin()[j];
+            return total;
+        }
+
+        template<typename T, std::size_t dim>
+        T sum(const Inner<T, dim>& arr)
+        {
+            T total = T();
+            for (std::size_t i = 0; i < arr.size(); ++i) total += detail::sum(arr.begin()[i]);
+            return total;
+        }
+
+        template<typename T>
+        void sum(const Inner<T, 1>& row, std::size_t, T& out, std::size_t)
+        {
+            out = detail::sum(row);
+        }
+
+        /**
+         * Sum along `axis` into `out`.
+         *
+         * Along the first axis, whole sub-arrays are added one after the
+         * other, so each row is read in order; the rows of the sub-array
+         * `distance` ahead are prefetched.
+         */
+        template<typename T, std::size_t dim>
+        void sum(const Inner<T, dim>& arr, std::size_t axis, Inner<T, dim - 1>& out, std::size_t distance)
+        {
+            if (axis != 0)
+            {
+                out.resize(arr.size());
+                for (std::size_t i = 0; i < arr.size(); ++i) detail::sum(arr.begin()[i], axis - 1, out.begin()[i], distance);
+                return;
+            }
+
+            if (arr.empty())
+            {
+                out.clear();
+                return;
+            }
+
+            out = arr.begin()[0];
+            for (std::size_t i = 1; i < arr.size(); ++i)
+            {
+                if (distance != 0 && i + distance < arr.size()) prefetchRows(arr.begin()[i + distance]);
+                accumulate(out, arr.begin()[i]);
+            }
+        }
+    }
+
+    /// Sum of all the elements of `arr`
+    template<typename T, std::size_t dim>
+    T sum(const Inner<T, dim>& arr)
+    {
+        detail::OpTimer timer;
+        const T total = detail::sum(arr);
+        timer.done<T>("sum", arr);
+        return total;
+    }
+
+    /**
+     * Sum of the elements of `arr` along `axis`, like `numpy.sum(arr, axis)`.
+     *
+     * @throws std::out_of_range if `axis` is out of range.
+     */
+    template<typename T, std::size_t dim>
+    Inner<T, dim - 1> sum(const Inner<T, dim>& arr, std::size_t axis)
+    {
+        static_assert(dim > 1, "Use sum(arr) to reduce a one dimensional array");
+        detail::OpTimer timer;
+        if (axis >= dim) detail::raise<std::out_of_range>("Axis out of range");
+
+        detail::InheritTag tag(detail::tagOf(arr, 0));
+        Inner<T, dim - 1> result;
+        detail::sum(arr, axis, result, prefetch_distance());
+        timer.done<T>("sum", arr, result);
+        return result;
+    }
+
+    /**
+     * sum() along `axis` into `out`, which keeps its storage.
+     *
+     * @throws std::out_of_range if `axis` is out of range.
+     * @throws std::invalid_argument if the shape of `out` differs.
+     */
+    template<typename T, std::size_t dim>
+    void sum(const Inner<T, dim>& arr, std::size_t axis, Inner<T, dim - 1>& out)
+    {
+        static_assert(dim > 1, "Use sum(arr) to reduce a one dimensional array");
+        detail::OpTimer timer;
+        if (axis >= dim) detail::raise<std::out_of_range>("Axis out of range");
+
+        const std::array<std::size_t, dim> shape = arr.shape();
+        std::array<std::size_t, dim - 1> expected;
+        for (std::size_t k = 0, j = 0; k < dim; ++k)
+            if (k != axis) expected[j++] = shape[k];
+
+        detail::checkShape(out.shape(), expected);
+        detail::sum(arr, axis, out, prefetch_distance());
+        timer.done<T>("sum", arr, out);
+    }
+
+    /** @} */
+
+
+    /**
+     * @addtogroup linalg Linear algebra
+     * Matrix products of two dimensional arrays.
+     * @{
+     */
+
+    namespace detail
+    {
+        /// `out = a * b`, row by row: each row of `out` accumulates the rows of `b` scaled by a row of `a`
+        template<typename T>
+        void matmul(const Inner<T, 2>& a, const Inner<T, 2>& b, Inner<T, 2>& out, Workspace&, std::false_type)
+        {
+            for (std::size_t i = 0; i < a.size(); ++i)
+            {
+                T* row = out.begin()[i].data();
+                std::fill_n(row, out.begin()[i].size(), T());
+
+                for (std::size_t k = 0; k < b.size(); ++k)
+                {
+                    const T scale = a.begin()[i].data()[k];
+                    const T* other = b.begin()[k].data();
+                    for (std::size_t j = 0; j < out.begin()[i].size(); ++j) row[j] += scale * other[j];
+                }
+            }
+        }
+
+        /**
+         * Same as above, one panel of `b` at a time.
+         *
+         * The rows of `b` are separate allocations; a panel of `kc` rows by
+         * `nc` columns is packed into one buffer of the workspace, which stays
+         * in the cache while every row of `a` is multiplied by it.
+         */
+        template<typename T>
+        void matmul(const Inner<T, 2>& a, const Inner<T, 2>& b, Inner<T, 2>& out, Workspace& workspace, std::true_type)
+        {
+            const std::size_t kc = 128, nc = 2048 / sizeof(T);
+            const std::size_t n = a.size(), depth = b.size(), m = n ? out.begin()[0].size() : 0;
+
+            for (std::size_t i = 0; i < n; ++i) std::fill_n(out.begin()[i].data(), m, T());
+
+            Workspace::Scope scope(workspace);
+            T* panel = workspace.allocate<T>(std::min(kc, depth) * std::min(nc, m));
+
+            for (std::size_t jj = 0; jj < m; jj += nc)
+            {
+                const std::size_t nb = std::min(nc, m - jj);
+                for (std::size_t kk = 0; kk < depth; kk += kc)
+                {
+                    const std::size_t kb = std::min(kc, depth - kk);
+                    for (std::size_t k = 0; k < kb; ++k)
+                        std::copy_n(b.begin()[kk + k].data() + jj, nb, panel + k * nb);
+
+                    for (std::size_t i = 0; i < n; ++i)
+                    {
+                        T* row = out.begin()[i].data() + jj;
+                        const T* scales = a.begin()[i].data() + kk;
+                        for (std::size_t k = 0; k < kb; ++k)
+                        {
+                            const T scale = scales[k];
+                            const T* other = panel + k * nb;
+                            for (std::size_t j = 0; j < nb; ++j) row[j] += scale * other[j];
+                        }
+                    }
+                }
+            }
+        }
+
+        template<typename T>
+        void matmul(const Inner<T, 2>& a, const Inner<T, 2>& b, Inner<T, 2>& out, Workspace& workspace)
+        {
+            matmul(a, b, out, workspace, std::integral_constant<bool, std::is_trivially_copyable<T>::value && !std::is_same<T, bool>::value>());
+        }
+
+        template<typename T>
+        std::array<std::size_t, 2> matmulShape(const Inner<T, 2>& a, const Inner<T, 2>& b)
+        {
+            const std::array<std::size_t, 2> sa = a.shape(), sb = b.shape();
+            if (sa[1] != sb[0]) detail::raise<std::invalid_argument>("Shapes are not aligned");
+            return {{sa[0], sb[1]}};
+        }
+    }
+
+    /**
+     * Matrix product of `a` and `b`.
+     *
+     * @throws std::invalid_argument if the columns of `a` are not the rows of `b`.
+     */
+    template<typename T>
+    Inner<T, 2> matmul(const Inner<T, 2>& a, const Inner<T, 2>& b, Workspace& workspace = Workspace::local())
+    {
+        detail::OpTimer timer;
+        const std::array<std::size_t, 2> shape = detail::matmulShape(a, b);
+
+        detail::InheritTag tag(detail::tagOf(a, 0));
+        Inner<T, 2> result(shape[0], shape[1], T());
+        detail::matmul(a, b, result, workspace);
+        timer.done<T>("matmul", a, b, result);
+        return result;
+    }
+
+    /**
+     * Matrix product of `a` and `b` into `out`, which keeps its storage and must not be `a` or `b`.
+     *
+     * @throws std::invalid_argument if the columns of `a` are not the rows of `b`, or if the shape of `out` differs.
+     */
+    template<typename T>
+    void matmul(const Inner<T, 2>& a, const Inner<T, 2>& b, Inner<T, 2>& out, Workspace& workspace = Workspace::local())
+    {
+        detail::OpTimer timer;
+        detail::checkShape(out.shape(), detail::matmulShape(a, b));
+        detail::matmul(a, b, out, workspace);
+        timer.done<T>("matmul", a, b, out);
+    }
+
+    /** @} */
+
+
+    /**
+     * @addtogroup categorical Categorical
+     * Dictionary encoded arrays.
+     * @{
+     */
+
+    /**
+     * An array of few distinct values, stored as a dictionary of the distinct
+     * values (the categories) and an Inner of integer codes into it.
+     *
+     * Counting, filtering and grouping work on the codes, without comparing
+     * the values themselves. The categories are kept in order of first
+     * appearance and `T` must be less-than comparable.
+     *
+     * @tparam T The type of the values.
+     * @tparam dim The number of dimensions.
+     * @tparam Code The unsigned integer type of the codes, which limits the number of categories.
+     *
+     * @include ndarray-categorical.cpp
+     */
+    template<typename T, std::size_t dim, typename Code = std::uint32_t>
+    class Categorical
+    {
+        static_assert(std::is_integral<Code>::value && std::is_unsigned<Code>::value, "Code must be an unsigned integer type");
+
+    public:
+        using dtype = T;
+        using code_type = Code;
+        static constexpr std::size_t ndim = dim;
+
+        Categorical() = default;
+
+        /// Encode `values`, throws std::out_of_range if there are more categories than `Code` can hold
+        explicit Categorical(const Inner<T, dim>& values)
+        {
+            std::map<T, Code> lookup;
+            encode(values, codes_, lookup);
+        }
+
+        /// Take existing `categories` and `codes`, throws std::invalid_argument if a code is out of range
+        Categorical(std::vector<T> categories, Inner<Code, dim> codes)
+            : categories_(std::move(categories)), codes_(std::move(codes))
+        {
+            if (!categories_.empty() && static_cast<std::uintmax_t>(categories_.size() - 1) > static_cast<std::uintmax_t>(std::numeric_limits<Code>::max()))
+                detail::raise<std::out_of_range>("Too many categories for the code type");
+
+            struct Check
+            {
+                std::size_t size;
+                void operator()(const Inner<Code, 1>& row, std::size_t)
+                {
+                    for (std::size_t j = 0; j < row.size(); ++j)
+                        if (row.data()[j] >= size) detail::raise<std::invalid_argument>("Code out of range of the categories");
+                }
+            } check = {categories_.size()};
+
+            detail::forEachRow(codes_, check);
+        }
+
+        const std::vector<T>& categories() const { return categories_; }
+        const Inner<Code, dim>& codes() const { return codes_; }
+
+        std::array<std::size_t, dim> shape() const { return codes_.shape(); }
+
+        /// Code of `value`, or `categories().size()` if it is not a category
+        std::size_t find(const T& value) const
+        {
+            return static_cast<std::size_t>(std::find(categories_.begin(), categories_.end(), value) - categories_.begin());
+        }
+
+        /// Unchecked element access by an array of indices
+        const T& get(const std::array<std::size_t, dim>& indices) const
+        {
+            return categories_[codes_.get(indices)];
+        }
+
+        /// Number of elements of each category, indexed by code
+        Inner<std::size_t, 1> value_counts() const
+        {
+            struct Count
+            {
+                Inner<std::size_t, 1>& counts;
+                void operator()(const Inner<Code, 1>& row, std::size_t)
+                {
+                    for (std::size_t j = 0; j < row.size(); ++j) ++counts.data()[row.data()[j]];
+                }
+            };
+
+            Inner<std::size_t, 1> counts(categories_.size(), 0);
+            Count count = {counts};
+            detail::forEachRow(codes_, count);
+            return counts;
+        }
+
+        /// Number of elements equal to `value`
+        std::size_t count(const T& value) const
+        {
+            struct Count
+            {
+                Code code;
+                std::size_t total;
+                void operator()(const Inner<Code, 1>& row, std::size_t)
+                {
+                    for (std::size_t j = 0; j < row.size(); ++j) total += (row.data()[j] == code);
+                }
+            };
+
+            const std::size_t code = find(value);
+            if (code == categories_.size()) return 0;
+
+            Count count = {static_cast<Code>(code), 0};
+            detail::forEachRow(codes_, count);
+            return count.total;
+        }
+
+        /// Whether each element is equal to `value`
+        Inner<bool, dim> mask(const T& value) const
+        {
+            return maskCode(find(value));
+        }
+
+        /**
+         * Sum of `values` for each category, indexed by code.
+         *
+         * @param values An array of the same shape, the values to group.
+         * @throws std::invalid_argument if the shapes differ.
+         */
+        template<typename U>
+        Inner<U, 1> group_sum(const Inner<U, dim>& values) const
+        {
+            if (values.shape() != codes_.shape())
+                detail::raise<std::invalid_argument>("Shape mismatch");
+
+            Inner<U, 1> sums(categories_.size(), U());
+            groupSum(codes_, values, sums);
+            return sums;
+        }
+
+        /// Decode to an Inner of values
+        Inner<T, dim> copy() const
+        {
+            Inner<T, dim> result;
+            decode(codes_, result);
+            return result;
+        }
+
+        std::string toString() const
+        {
+            return copy().toString();
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const Categorical& cat)
+        {
+            return os << cat.toString();
+        }
+
+    private:
+        std::vector<T> categories_;
+        Inner<Code, dim> codes_;
+
+        void encode(const Inner<T, 1>& values, Inner<Code, 1>& codes, std::map<T, Code>& lookup)
+        {
+            codes.resize(values.size());
+            for (std::size_t j = 0; j < values.size(); ++j)
+            {
+                const T& value = values.begin()[j];
+                typename std::map<T, Code>::const_iterator it = lookup.find(value);
+                if (it == lookup.end())
+                {
+                    if (categories_.size() > static_cast<std::size_t>(std::numeric_limits<Code>::max()))
+                        detail::raise<std::out_of_range>("Too many categories for the code type");
+
+                    it = lookup.insert(std::make_pair(value, static_cast<Code>(categories_.size()))).first;
+                    categories_.push_back(value);
+                }
+                codes.data()[j] = it->second;
+            }
+        }
+
+        template<std::size_t k>
+        void encode(const Inner<T, k>& values, Inner<Code, k>& codes, std::map<T, Code>& lookup)
+        {
+            codes.resize(values.size());
+            for (std::size_t i = 0; i < values.size(); ++i)
+                encode(values.begin()[i], codes.begin()[i], lookup);
+        }
+
+        void decode(const Inner<Code, 1>& codes, Inner<T, 1>& values) const
+        {
+            values.resize(codes.size());
+            for (std::size_t j = 0; j < codes.size(); ++j)
+                values.begin()[j] = categories_[codes.data()[j]];
+        }
+
+        template<std::size_t k>
+        void decode(const Inner<Code, k>& codes, Inner<T, k>& values) const
+        {
+            values.resize(codes.size());
+            for (std::size_t i = 0; i < codes.size(); ++i)
+                decode(codes.begin()[i], values.begin()[i]);
+        }
+
+        Inner<bool, dim> maskCode(std::size_t code) const
+        {
+            Inner<bool, dim> result;
+            mask(codes_, static_cast<Code>(code), code < categories_.size(), result);
+            return result;
+        }
+
+        static void mask(const Inner<Code, 1>& codes, Code code, bool found, Inner<bool, 1>& result)
+        {
+            result.assign(codes.size(), false);
+            if (!found) return;
+            for (std::size_t j = 0; j < codes.size(); ++j)
+                if (codes.data()[j] == code) result.begin()[j] = true;
+        }
+
+        template<std::size_t k>
+        static void mask(const Inner<Code, k>& codes, Code code, bool found, Inner<bool, k>& result)
+        {
+            result.resize(codes.size());
+            for (std::size_t i = 0; i < codes.size(); ++i)
+                mask(codes.begin()[i], code, found, result.begin()[i]);
+        }
+
+        template<typename U>
+        static void groupSum(const Inner<Code, 1>& codes, const Inner<U, 1>& values, Inner<U, 1>& sums)
+        {
+            for (std::size_t j = 0; j < codes.size(); ++j)
+                sums.begin()[codes.data()[j]] += values.begin()[j];
+        }
+
+        template<typename U, std::size_t k>
+        static void groupSum(const Inner<Code, k>& codes, const Inner<U, k>& values, Inner<U, 1>& sums)
+        {
+            for (std::size_t i = 0; i < codes.size(); ++i)
+                groupSum(codes.begin()[i], values.begin()[i], sums);
+        }
+    };
+
+    template<typename T, std::size_t dim, typename Code>
+    constexpr std::size_t Categorical<T, dim, Code>::ndim;
+
+    /// Encode `values` as a Categorical
+    template<typename Code = std::uint32_t, typename T, std::size_t dim>
+    Categorical<T, dim, Code> categorical(const Inner<T, dim>& values)
+    {
+        return Categorical<T, dim, Code>(values);
+    }
+
+    /** @} */
+
+
+    /**
+     * @addtogroup compressed Compressed
+     * Compressed one dimensional arrays.
+     *
+     * Both arrays answer reductions, range filters and slices on the
+     * compressed form, and decompress only when copied to an Inner. They also
+     * follow the expression protocol, so they can be used in expressions and
+     * assigned to an Inner directly.
+     * @{
+     */
+
+    /**
+     * A run-length encoded array, for data with long runs of equal values.
+     *
+     * Each run is stored as its value and the position where it ends, random
+     * access is a binary search over the runs.
+     *
+     * @include ndarray-compressed.cpp
+     */
+    template<typename T>
+    class RleArray
+    {
+        template<typename> friend class RleArray;
+
+    public:
+        using dtype = T;
+        using const_reference = typename std::vector<T>::const_reference;
+        static constexpr std::size_t ndim = 1;
+
+        RleArray() = default;
+
+        explicit RleArray(const Inner<T, 1>& values)
+        {
+            for (typename Inner<T, 1>::const_iterator it = values.begin(); it != values.end(); ++it)
+                append(*it, 1);
+        }
+
+        std::size_t size() const { return ends_.empty() ? 0 : ends_.back(); }
+        std::array<std::size_t, 1> shape() const { return {{size()}}; }
+
+        /// Number of runs
+        std::size_t runs() const { return values_.size(); }
+
+        /// Checked element access, negative indices count from the end
+        const_reference operator()(int idx) const
+        {
+            if (idx < 0) idx += static_cast<int>(size());
+            if (idx < 0 || static_cast<std::size_t>(idx) >= size()) detail::raise<std::out_of_range>("Index out of range");
+            return values_[run(idx)];
+        }
+
+        /// Unchecked element access by an array of indices
+        const_reference get(const std::array<std::size_t, 1>& indices) const
+        {
+            return values_[run(indices[0])];
+        }
+
+        T sum() const
+        {
+            T total = T();
+            for (std::size_t r = 0; r < runs(); ++r) total += values_[r] * static_cast<T>(length(r));
+            return total;
+        }
+
+        /// Smallest element, throws std::invalid_argument if the array is empty
+        T min() const
+        {
+            if (values_.empty()) detail::raise<std::invalid_argument>("Empty array");
+            return *std::min_element(values_.begin(), values_.end());
+        }
+
+        /// Largest element, throws std::invalid_argument if the array is empty
+        T max() const
+        {
+            if (values_.empty()) detail::raise<std::invalid_argument>("Empty array");
+            return *std::max_element(values_.begin(), values_.end());
+        }
+
+        /// Number of elements in `[lo, hi]`
+        std::size_t count_between(const T& lo, const T& hi) const
+        {
+            std::size_t count = 0;
+            for (std::size_t r = 0; r < runs(); ++r)
+                if (!(values_[r] < lo) && !(hi < values_[r])) count += length(r);
+            return count;
+        }
+
+        /// Whether each element is in `[lo, hi]`
+        RleArray<bool> between(const T& lo, const T& hi) const
+        {
+            RleArray<bool> result;
+            for (std::size_t r = 0; r < runs(); ++r)
+                result.append(!(values_[r] < lo) && !(hi < values_[r]), length(r));
+            return result;
+        }
+
+        /// Elements in `[start, stop)`, with the same rules as a Range
+        RleArray slice(int start, int stop) const
+        {
+            const Range::Bounds bounds = range(start, stop).resolve(size());
+
+            RleArray result;
+            if (bounds.length == 0) return result;
+
+            const std::size_t first = static_cast<std::size_t>(bounds.start), last = first + bounds.length;
+            for (std::size_t r = run(first); r < runs() && begin(r) < last; ++r)
+                result.append(values_[r], std::min(ends_[r], last) - std::max(begin(r), first));
+            return result;
+        }
+
+        /// Decompress to an Inner
+        Inner<T, 1> copy() const
+        {
+            Inner<T, 1> result;
+            result.reserve(size());
+            for (std::size_t r = 0; r < runs(); ++r) result.insert(result.end(), length(r), values_[r]);
+            return result;
+        }
+
+        std::string toString() const
+        {
+            return copy().toString();
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const RleArray& arr)
+        {
+            return os << arr.toString();
+        }
+
+    private:
+        std::vector<T> values_;
+        std::vector<std::size_t> ends_;
+
+        std::size_t begin(std::size_t r) const { return r == 0 ? 0 : ends_[r - 1]; }
+        std::size_t length(std::size_t r) const { return ends_[r] - begin(r); }
+
+        /// Index of the run containing position `i`
+        std::size_t run(std::size_t i) const
+        {
+            return static_cast<std::size_t>(std::upper_bound(ends_.begin(), ends_.end(), i) - ends_.begin());
+        }
+
+        void append(const T& value, std::size_t count)
+        {
+            if (count == 0) return;
+            if (!values_.empty() && values_.back() == value)
+            {
+                ends_.back() += count;
+                return;
+            }
+            values_.push_back(value);
+            ends_.push_back(size() + count);
+        }
+    };
+
+    template<typename T>
+    constexpr std::size_t RleArray<T>::ndim;
+
+    namespace detail
+    {
+        /**
+         * Unpack `count` values of `width` bits, starting at bit `bit` of `words`.
+         *
+         * `words` must have one more word after the last value.
+         */
+        inline void unpackBits(const std::uint64_t* words, std::size_t bit, unsigned width, std::size_t count, std::uint64_t* out)
+        {
+            const std::uint64_t mask = width == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << width) - 1;
+
+            std::size_t j = 0;
+#if defined(PP_NDARRAY_AVX512)
+            // Eight values at a time: gather the two words holding each value and funnel shift them.
+            // The masked forms with all lanes set avoid GCC warnings about the undefined source of the plain ones.
+            const __mmask8 all = 0xFF;
+            const __m512i zero = _mm512_setzero_si512();
+            const long long w = width;
+            const __m512i lanes = _mm512_set_epi64(7 * w, 6 * w, 5 * w, 4 * w, 3 * w, 2 * w, w, 0);
+            const __m512i vmask = _mm512_set1_epi64(static_cast<long long>(mask));
+            for (; j + 8 <= count; j += 8)
+            {
+                const __m512i pos = _mm512_add_epi64(_mm512_set1_epi64(static_cast<long long>(bit + j * width)), lanes);
+                const __m512i index = _mm512_maskz_srli_epi64(all, pos, 6), shift = _mm512_and_si512(pos, _mm512_set1_epi64(63));
+                const __m512i lo = _mm512_mask_i64gather_epi64(zero, all, index, words, 8);
+                const __m512i hi = _mm512_mask_i64gather_epi64(zero, all, _mm512_add_epi64(index, _mm512_set1_epi64(1)), words, 8);
+                const __m512i value = _mm512_or_si512(_mm512_maskz_srlv_epi64(all, lo, shift),
+                                                      _mm512_maskz_sllv_epi64(all, hi, _mm512_sub_epi64(_mm512_set1_epi64(64), shift)));
+                _mm512_storeu_si512(out + j, _mm512_and_si512(value, vmask));
+            }
+#endif
+            for (; j < count; ++j)
+            {
+                const std::size_t pos = bit + j * width, shift = pos & 63;
+                std::uint64_t value = words[pos >> 6] >> shift;
+                if (shift + width > 64) value |= words[(pos >> 6) + 1] << (64 - shift);
+                out[j] = value & mask;
+            }
+        }
+    }
+
+    /**
+     * A frame of reference encoded array, for integers that vary over a small range.
+     *
+     * The elements are split in blocks of `block_size`, each block stores its
+     * minimum and the differences to it, packed with as few bits as the
+     * largest difference needs. The minimum and maximum of each block let
+     * reductions and range filters skip most blocks without unpacking them.
+     *
+     * The blocks are never modified, so a slice is a window that shares the
+     * blocks of the array it was taken from and keeps all of them alive;
+     * encode its copy() again to release the rest. Its first and last blocks
+     * may be partial: their summaries do not hold for the window, so those
+     * two blocks are unpacked where a whole block would be skipped.
+     *
+     * @include ndarray-compressed.cpp
+     */
+    template<typename T>
+    class ForArray
+    {
+        static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value, "ForArray only holds integers");
+
+        using Unsigned = typename std::make_unsigned<T>::type;
+
+    public:
+        using dtype = T;
+        static constexpr std::size_t ndim = 1;
+        static constexpr std::size_t block_size = 128;
+
+        ForArray() : packed_(std::make_shared<Packed>()), start_(0), size_(0) {}
+
+        explicit ForArray(const Inner<T, 1>& values) : start_(0), size_(values.size())
+        {
+            std::shared_ptr<Packed> packed = std::make_shared<Packed>();
+            packed->words.clear();
+            for (std::size_t first = 0; first < size_; first += block_size)
+            {
+                const std::size_t n = std::min(block_size, size_ - first);
+                const T* block = values.data() + first;
+                const std::pair<const T*, const T*> bounds = std::minmax_element(block, block + n);
+                const unsigned width = bits(delta(*bounds.second, *bounds.first));
+
+                packed->mins.push_back(*bounds.first);
+                packed->maxs.push_back(*bounds.second);
+                packed->widths.push_back(static_cast<std::uint8_t>(width));
+                packed->offsets.push_back(packed->words.size());
+
+                packed->words.resize(packed->words.size() + (n * width + 63) / 64, 0);
+                std::uint64_t* words = packed->words.data() + packed->offsets.back();
+                for (std::size_t j = 0; j < n && width != 0; ++j)
+                {
+                    const std::uint64_t value = delta(block[j], *bounds.first);
+                    const std::size_t pos = j * width, shift = pos & 63;
+                    words[pos >> 6] |= value << shift;
+                    if (shift + width > 64) words[(pos >> 6) + 1] |= value >> (64 - shift);
+                }
+            }
+            packed->words.push_back(0);
+            packed->size = size_;
+            packed_ = std::move(packed);
+        }
+
+        std::size_t size() const { return size_; }
+        std::array<std::size_t, 1> shape() const { return {{size_}}; }
+
+        /// Size of the packed data in bytes, shared with the slices of the array
+        std::size_t bytes() const
+        {
+            return packed_->words.size() * sizeof(std::uint64_t) + packed_->mins.size() * (2 * sizeof(T) + sizeof(std::uint8_t) + sizeof(std::size_t));
+        }
+
+        /// Checked element access, negative indices count from the end
+        T operator()(int idx) const
+        {
+            if (idx < 0) idx += static_cast<int>(size_);
+            if (idx < 0 || static_cast<std::size_t>(idx) >= size_) detail::raise<std::out_of_range>("Index out of range");
+            return get({{static_cast<std::size_t>(idx)}});
+        }
+
+        /// Unchecked element access by an array of indices
+        T get(const std::array<std::size_t, 1>& indices) const
+        {
+            const std::size_t pos = start_ + indices[0], b = pos / block_size;
+            std::uint64_t value;
+            detail::unpackBits(packed_->words.data() + packed_->offsets[b], (pos % block_size) * packed_->widths[b], packed_->widths[b], 1, &value);
+            return undelta(packed_->mins[b], value);
+        }
+
+        T sum() const
+        {
+            Unsigned total = 0;
+            std::uint64_t buffer[block_size];
+            for (std::size_t b = 0; b < blocks(); ++b)
+            {
+                const Segment s = segment(b);
+                total += static_cast<Unsigned>(static_cast<Unsigned>(packed_->mins[s.block]) * s.length());
+                if (packed_->widths[s.block] == 0) continue;
+
+                unpack(s, buffer);
+                for (std::size_t j = 0; j < s.length(); ++j) total += static_cast<Unsigned>(buffer[j]);
+            }
+            return static_cast<T>(total);
+        }
+
+        /// Smallest element, throws std::invalid_argument if the array is empty
+        T min() const
+        {
+            if (size_ == 0) detail::raise<std::invalid_argument>("Empty array");
+
+            std::uint64_t buffer[block_size];
+            T result = std::numeric_limits<T>::max();
+            for (std::size_t b = 0; b < blocks(); ++b)
+            {
+                const Segment s = segment(b);
+                if (packed_->mins[s.block] >= result) continue;
+                if (whole(s)) result = packed_->mins[s.block];
+                else
+                {
+                    unpack(s, buffer);
+                    result = std::min(result, undelta(packed_->mins[s.block], *std::min_element(buffer, buffer + s.length())));
+                }
+            }
+            return result;
+        }
+
+        /// Largest element, throws std::invalid_argument if the array is empty
+        T max() const
+        {
+            if (size_ == 0) detail::raise<std::invalid_argument>("Empty array");
+
+            std::uint64_t buffer[block_size];
+            T result = std::numeric_limits<T>::min();
+            for (std::size_t b = 0; b < blocks(); ++b)
+            {
+                const Segment s = segment(b);
+                if (packed_->maxs[s.block] <= result) continue;
+                if (whole(s)) result = packed_->maxs[s.block];
+                else
+                {
+                    unpack(s, buffer);
+                    result = std::max(result, undelta(packed_->mins[s.block], *std::max_element(buffer, buffer + s.length())));
+                }
+            }
+            return result;
+        }
+
+        /// Number of elements in `[lo, hi]`
+        std::size_t count_between(T lo, T hi) const
+        {
+            std::size_t count = 0;
+            std::uint64_t buffer[block_size];
+            for (std::size_t b = 0; b < blocks(); ++b)
+            {
+                const Segment s = segment(b);
+                const T min = packed_->mins[s.block], max = packed_->maxs[s.block];
+                if (max < lo || hi < min) continue;
+                if (lo <= min && max <= hi)
+                {
+                    count += s.length();
+                    continue;
+                }
+
+                const std::uint64_t first = lo <= min ? 0 : delta(lo, min);
+                const std::uint64_t last = hi >= max ? delta(max, min) : delta(hi, min);
+                unpack(s, buffer);
+                for (std::size_t j = 0; j < s.length(); ++j) count += (buffer[j] >= first && buffer[j] <= last);
+            }
+            return count;
+        }
+
+        /// Whether each element is in `[lo, hi]`
+        Inner<bool, 1> between(T lo, T hi) const
+        {
+            Inner<bool, 1> result(size_, false);
+            std::uint64_t buffer[block_size];
+            for (std::size_t b = 0; b < blocks(); ++b)
+            {
+                const Segment s = segment(b);
+                if (packed_->maxs[s.block] < lo || hi < packed_->mins[s.block]) continue;
+
+                unpack(s, buffer);
+                for (std::size_t j = 0; j < s.length(); ++j)
+                {
+                    const T value = undelta(packed_->mins[s.block], buffer[j]);
+                    result.begin()[s.first + j] = lo <= value && value <= hi;
+                }
+            }
+            return result;
+        }
+
+        /// Elements in `[start, stop)`, with the same rules as a Range; shares the blocks, nothing is unpacked
+        ForArray slice(int start, int stop) const
+        {
+            const Range::Bounds bounds = range(start, stop).resolve(size_);
+
+            ForArray result(*this);
+            result.start_ = start_ + static_cast<std::size_t>(bounds.start);
+            result.size_ = bounds.length;
+            return result;
+        }
+
+        /// Decompress to an Inner
+        Inner<T, 1> copy() const
+        {
+            Inner<T, 1> result(size_);
+            std::uint64_t buffer[block_size];
+            for (std::size_t b = 0; b < blocks(); ++b)
+            {
+                const Segment s = segment(b);
+                unpack(s, buffer);
+                for (std::size_t j = 0; j < s.length(); ++j) result.data()[s.first + j] = undelta(packed_->mins[s.block], buffer[j]);
+            }
+            return result;
+        }
+
+        std::string toString() const
+        {
+            return copy().toString();
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const ForArray& arr)
+        {
+            return os << arr.toString();
+        }
+
+    private:
+        /// The blocks of the array that was encoded
+        struct Packed
+        {
+            std::size_t size = 0;
+            std::vector<T> mins, maxs;
+            std::vector<std::uint8_t> widths;
+            std::vector<std::size_t> offsets;
+            std::vector<std::uint64_t> words = std::vector<std::uint64_t>(1, 0);
+        };
+
+        /// The part of block `block` in the window: its elements `[from, to)`, the first one at index `first` of the window
+        struct Segment
+        {
+            std::size_t block, from, to, first;
+            std::size_t length() const { return to - from; }
+        };
+
+        std::shared_ptr<const Packed> packed_;
+        std::size_t start_;     ///< Position of the first element in the blocks
+        std::size_t size_;
+
+        /// Number of blocks the window overlaps
+        std::size_t blocks() const
+        {
+            return size_ == 0 ? 0 : (start_ + size_ - 1) / block_size - start_ / block_size + 1;
+        }
+
+        Segment segment(std::size_t b) const
+        {
+            const std::size_t block = start_ / block_size + b, begin = block * block_size;
+            const std::size_t from = std::max(begin, start_) - begin;
+            const Segment s = {block, from, std::min(begin + block_size, start_ + size_) - begin, begin + from - start_};
+            return s;
+        }
+
+        /// Whether the window holds the whole block, so its minimum and maximum are the ones of the segment
+        bool whole(const Segment& s) const
+        {
+            return s.from == 0 && s.to == std::min(block_size, packed_->size - s.block * block_size);
+        }
+
+        /// Unpack the differences of the segment into `buffer`
+        void unpack(const Segment& s, std::uint64_t* buffer) const
+        {
+            const unsigned width = packed_->widths[s.block];
+            detail::unpackBits(packed_->words.data() + packed_->offsets[s.block], s.from * width, width, s.length(), buffer);
+        }
+
+        static std::uint64_t delta(T value, T min) { return static_cast<Unsigned>(static_cast<Unsigned>(value) - static_cast<Unsigned>(min)); }
+        static T undelta(T min, std::uint64_t value) { return static_cast<T>(static_cast<Unsigned>(static_cast<Unsigned>(min) + static_cast<Unsigned>(value))); }
+
+        static unsigned bits(std::uint64_t value)
+        {
+            unsigned width = 0;
+            for (; value != 0; value >>= 1) ++width;
+            return width;
+        }
+    };
+
+    template<typename T>
+    constexpr std::size_t ForArray<T>::ndim;
+
+    template<typename T>
+    constexpr std::size_t ForArray<T>::block_size;
+
+    /** @} */
+
+
+    /**
+     * @addtogroup layout Layout
+     * Arrays stored in a single buffer, in an order other than row-major.
+     *
+     * Images and voxel grids are often read by neighbourhood. In row-major
+     * order, the neighbours along the first axis are a whole row apart; a
+     * Morton (Z-order) or tiled layout keeps them close in memory in every
+     * direction.
+     * @{
+     */
+
+    /**
+     * Z-order curve: the bits of the indices are interleaved, the last axis in the lowest bit.
+     *
+     * The curve fills cubes whose side is a power of two. An array is cut into
+     * cubes whose side is its smallest axis rounded up to a power of two,
+     * which are stored one after the other in row-major order, each along the
+     * curve; a cube shaped array is one cube. Each axis is padded to a whole
+     * number of cubes, less than twice its length: a 1000 x 1000 array takes
+     * 1024 x 1024 elements, a 2 x 1024 array none more, a 5 x 5 array 8 x 8.
+     *
+     * Uses the BMI2 `pdep` instruction when available. On processors where
+     * it is microcoded (AMD before Zen 3), define PP_NDARRAY_NO_SIMD.
+     */
+    template<std::size_t dim>
+    struct MortonLayout
+    {
+        static_assert(dim == 2 || dim == 3, "Morton layout is for 2 or 3 dimensions");
+
+        /// Bits per axis which fit in a 64 bit code
+        static constexpr unsigned bits = 64 / dim;
+
+        static std::uint64_t spread(std::uint64_t x)
+        {
+#if defined(PP_NDARRAY_BMI2)
+            return _pdep_u64(x, dim == 2 ? 0x5555555555555555ull : 0x1249249249249249ull);
+#else
+            if (dim == 2)
+            {
+                x &= 0xFFFFFFFFull;
+                x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+                x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+                x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+                x = (x | (x << 2)) & 0x3333333333333333ull;
+                return (x | (x << 1)) & 0x5555555555555555ull;
+            }
+            x &= 0x1FFFFFull;
+            x = (x | (x << 32)) & 0x001F00000000FFFFull;
+            x = (x | (x << 16)) & 0x001F0000FF0000FFull;
+            x = (x | (x << 8)) & 0x100F00F00F00F00Full;
+            x = (x | (x << 4)) & 0x10C30C30C30C30C3ull;
+            return (x | (x << 2)) & 0x1249249249249249ull;
+#endif
+        }
+
+        /// Side of the cubes as a power of two: the smallest axis, rounded up
+        static unsigned cubeBits(const std::array<std::size_t, dim>& shape)
+        {
+            const std::size_t smallest = *std::min_element(shape.begin(), shape.end());
+            if (smallest <= 1) return 0;
+#if defined(__GNUC__) || defined(__clang__)
+            return 64 - static_cast<unsigned>(__builtin_clzll(static_cast<unsigned long long>(smallest - 1)));
+#else
+            unsigned b = 0;
+            while ((std::size_t(1) << b) < smallest) ++b;
+            return b;
+#endif
+        }
+
+        static std::size_t index(const std::array<std::size_t, dim>& shape, const std::array<std::size_t, dim>& indices)
+        {
+            const unsigned b = cubeBits(shape);
+            const std::size_t mask = (std::size_t(1) << b) - 1;
+
+            std::size_t cube = 0;
+            std::uint64_t code = 0;
+            for (std::size_t k = 0; k < dim; ++k)
+            {
+                cube = cube * (((shape[k] - 1) >> b) + 1) + (indices[k] >> b);
+                code |= spread(indices[k] & mask) << (dim - 1 - k);
+            }
+            return (cube << (b * dim)) + static_cast<std::size_t>(code);
+        }
+
+        /// Size of the buffer, each axis padded to a whole number of cubes
+        static std::size_t size(const std::array<std::size_t, dim>& shape)
+        {
+            for (std::size_t k = 0; k < dim; ++k)
+                if (shape[k] == 0) return 0;
+
+            const unsigned b = cubeBits(shape);
+            if (b > bits) detail::raise<std::invalid_argument>("Shape too large for a Morton layout");
+
+            std::size_t n = 1;
+            for (std::size_t k = 0; k < dim; ++k) n *= (((shape[k] - 1) >> b) + 1) << b;
+            return n;
+        }
+    };
+
+    template<std::size_t dim>
+    constexpr unsigned MortonLayout<dim>::bits;
+
+    /// Square tiles of `tile` by `tile` elements, the tiles and the elements in a tile in row-major order
+    template<std::size_t tile>
+    struct TiledLayout
+    {
+        static_assert(tile != 0 && (tile & (tile - 1)) == 0, "Tile size must be a power of two");
+
+        static std::size_t index(const std::array<std::size_t, 2>& shape, const std::array<std::size_t, 2>& indices)
+        {
+            const std::size_t tiles = (shape[1] + tile - 1) / tile;
+            return ((indices[0] / tile) * tiles + indices[1] / tile) * tile * tile + (indices[0] % tile) * tile + indices[1] % tile;
+        }
+
+        static std::size_t size(const std::array<std::size_t, 2>& shape)
+        {
+            return ((shape[0] + tile - 1) / tile) * ((shape[1] + tile - 1) / tile) * tile * tile;
+        }
+    };
+
+    /**
+     * An array stored in one buffer in the order given by `Layout`.
+     *
+     * Elements are accessed with `operator()` as with an Inner; the buffer
+     * may be larger than the number of elements, to pad the shape to whole
+     * tiles or Morton cubes.
+     *
+     * @tparam Layout Provides `size(shape)`, the size of the buffer, and `index(shape, indices)`.
+     *
+     * @include ndarray-layout.cpp
+     */
+    template<typename T, std::size_t dim, typename Layout>
+    class LayoutArray
+    {
+    public:
+        using dtype = T;
+        static constexpr std::size_t ndim = dim;
+
+        LayoutArray() : shape_() {}
+
+        explicit LayoutArray(const std::array<std::size_t, dim>& shape, const T& value = T())
+            : shape_(shape), data_(Layout::size(shape), value) {}
+
+        explicit LayoutArray(const Inner<T, dim>& arr)
+            : LayoutArray(arr.shape())
+        {
+            std::array<std::size_t, dim> indices = {};
+            assign(arr, indices, std::integral_constant<std::size_t, 0>());
+        }
+
+        const std::array<std::size_t, dim>& shape() const { return shape_; }
+
+        /// The buffer, in the order of the layout
+        T* data() { return data_.data(); }
+        const T* data() const { return data_.data(); }
+
+        /// Checked element access, negative indices count from the end
+        template<typename... Indices>
+        T& operator()(Indices... indices)
+        {
+            return data_[checkedIndex(indices...)];
+        }
+
+        template<typename... Indices>
+        const T& operator()(Indices... indices) const
+        {
+            return data_[checkedIndex(indices...)];
+        }
+
+        /// Unchecked element access by an array of indices
+        const T& get(const std::array<std::size_t, dim>& indices) const
+        {
+            return data_[Layout::index(shape_, indices)];
+        }
+
+        /// Copy to a row-major Inner
+        Inner<T, dim> copy() const
+        {
+            Inner<T, dim> result;
+            detail::evaluate(*this, result);
+            return result;
+        }
+
+        std::string toString() const
+        {
+            return copy().toString();
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const LayoutArray& arr)
+        {
+            return os << arr.toString();
+        }
+
+    private:
+        std::array<std::size_t, dim> shape_;
+        std::vector<T> data_;
+
+        template<typename... Indices>
+        std::size_t checkedIndex(Indices... indices) const
+        {
+            static_assert(sizeof...(Indices) == dim, "One index per axis is required");
+
+            const int raw[] = {static_cast<int>(indices)...};
+            std::array<std::size_t, dim> index;
+            for (std::size_t k = 0; k < dim; ++k)
+            {
+                const long long i = raw[k] < 0 ? raw[k] + static_cast<long long>(shape_[k]) : raw[k];
+                if (i < 0 || static_cast<std::size_t>(i) >= shape_[k]) detail::raise<std::out_of_range>("Index out of range");
+                index[k] = static_cast<std::size_t>(i);
+            }
+            return Layout::index(shape_, index);
+        }
+
+        template<std::size_t k>
+        void assign(const Inner<T, dim - k>& arr, std::array<std::size_t, dim>& indices, std::integral_constant<std::size_t, k>)
+        {
+            for (indices[k] = 0; indices[k] < arr.size(); ++indices[k])
+                assign(arr.begin()[indices[k]], indices, std::integral_constant<std::size_t, k + 1>());
+        }
+
+        void assign(const Inner<T, 1>& row, std::array<std::size_t, dim>& indices, std::integral_constant<std::size_t, dim - 1>)
+        {
+            for (indices[dim - 1] = 0; indices[dim - 1] < row.size(); ++indices[dim - 1])
+                data_[Layout::index(shape_, indices)] = row.begin()[indices[dim - 1]];
+        }
+    };
+
+    template<typename T, std::size_t dim, typename Layout>
+    constexpr std::size_t LayoutArray<T, dim, Layout>::ndim;
+
+    /// A 2 or 3 dimensional array in Z-order
+    template<typename T, std::size_t dim>
+    using MortonArray = LayoutArray<T, dim, MortonLayout<dim>>;
+
+    /// A 2 dimensional array in tiles of `tile` by `tile` elements
+    template<typename T, std::size_t tile = 8>
+    using TiledArray = LayoutArray<T, 2, TiledLayout<tile>>;
+
+    /** @} */
+
+
+    /**
+     * @addtogroup buffer Buffer views
+     * Views of memory the array does not own.
+     *
+     * A BufferView reads elements from a pointer, a shape and a stride per
+     * axis, counted in elements, like a NumPy array over a foreign buffer.
+     * Like View, it never copies and the memory must outlive it, unless the
+     * view owns it: from_buffer() with a deleter adopts a buffer, which is
+     * released when the last view sharing it is destroyed. copy() or
+     * assigning it to an Inner makes an owning copy. It is an expression,
+     * so it can be an operand of the arithmetic operators and of eval().
+     *
+     * When an mdspan implementation is found, `std::mdspan` from C++23 or
+     * the reference implementation in `<experimental/mdspan>`,
+     * `as_mdspan()` gives the elements of an `Inner<T, 1>`, a DynArray or
+     * a BufferView as an mdspan, and a BufferView can view any strided
+     * mdspan. The rows of an Inner of more dimensions are separate vectors,
+     * which an mdspan cannot describe: view them with View, or move the
+     * array into a DynArray.
+     *
+     * @code
+     * pp::DynArray<double> grid({64, 64});
+     * pp::mdspan<double, 2> span = grid.as_mdspan<2>();     // e.g. to a stencil library
+     * pp::BufferView<double, 2> back(span);                // and back, e.g. from a solver
+     * pp::Ndarray<double[2]> twice = back + back;
+     * @endcode
+     * @{
+     */
+
+    /// Non-owning strided view of the elements at a pointer, `T` may be const
+    template<typename T, std::size_t dim>
+    class BufferView
+    {
+        static_assert(dim >= 1, "Dimension must be greater than zero!");
+
+    public:
+        using dtype = typename std::remove_const<T>::type;                 ///< Type of the elements
+        static constexpr std::size_t ndim = dim;                           ///< Number of dimensions
+        using shape_type = std::array<std::size_t, dim>;                   ///< Length of each axis
+        using strides_type = std::array<std::ptrdiff_t, dim>;              ///< Elements between neighbours along each axis
+
+        BufferView() : data_(nullptr), shape_(), strides_(), owner_() {}
+
+        /// View of the elements at `data`, in row-major order
+        BufferView(T* data, const shape_type& shape) : data_(data), shape_(shape), strides_(), owner_()
+        {
+            std::ptrdiff_t stride = 1;
+            for (std::size_t k = dim; k-- > 0;)
+            {
+                strides_[k] = stride;
+                stride *= static_cast<std::ptrdiff_t>(shape_[k]);
+            }
+        }
+
+        /// View of the elements at `data`, with `strides` in elements, which may be negative or zero
+        BufferView(T* data, const shape_type& shape, const strides_type& strides) : data_(data), shape_(shape), strides_(strides), owner_() {}
+
+        /// View which keeps `owner`, the memory of the elements, alive
+        BufferView(T* data, const shape_type& shape, const strides_type& strides, std::shared_ptr<const void> owner)
+            : data_(data), shape_(shape), strides_(strides), owner_(std::move(owner)) {}
+
+        /// A read-only view of a writable one
+        template<typename U, typename = typename std::enable_if<std::is_same<const U, T>::value && !std::is_same<U, T>::value>::type>
+        BufferView(const BufferView<U, dim>& other) : data_(other.data()), shape_(other.shape()), strides_(other.strides()), owner_(other.owner()) {}
+
+#if defined(PP_NDARRAY_MDSPAN_NAMESPACE)
+        /**
+         * View of the elements of `span`.
+         *
+         * @throws std::invalid_argument if the layout of `span` is not strided.
+         */
+        template<typename Extents, typename Layout>
+        BufferView(const PP_NDARRAY_MDSPAN_NAMESPACE::mdspan<T, Extents, Layout, PP_NDARRAY_MDSPAN_NAMESPACE::default_accessor<T>>& span)
+            : data_(span.data_handle()), shape_(), strides_(), owner_()
+        {
+            static_assert(Extents::rank() == dim, "The mdspan must have the dimension of the view");
+
+            if (!span.is_strided()) detail::raise<std::invalid_argument>("The layout of the mdspan is not strided");
+            for (std::size_t k = 0; k < dim; ++k)
+            {
+                shape_[k] = static_cast<std::size_t>(span.extent(k));
+                strides_[k] = static_cast<std::ptrdiff_t>(span.stride(k));
+            }
+        }
+
+        /**
+         * The elements as an mdspan, nothing is copied.
+         *
+         * @throws std::invalid_argument if a stride is not positive, which layout_stride does not allow.
+         */
+        strided_mdspan<T, dim> as_mdspan() const
+        {
+            std::array<std::size_t, dim> strides;
+            for (std::size_t k = 0; k < dim; ++k)
+            {
+                if (strides_[k] <= 0) detail::raise<std::invalid_argument>("The strides of an mdspan must be positive");
+                strides[k] = static_cast<std::size_t>(strides_[k]);
+            }
+
+            using extents_type = typename strided_mdspan<T, dim>::extents_type;
+            using mapping_type = typename strided_mdspan<T, dim>::mapping_type;
+            return strided_mdspan<T, dim>(data_, mapping_type(extents_type(shape_), strides));
+        }
+#endif
+
+        T* data() const { return data_; }                                  ///< The element at index 0 on every axis
+        const shape_type& shape() const { return shape_; }                 ///< Length of each axis
+        const strides_type& strides() const { return strides_; }           ///< Elements between neighbours along each axis
+        std::size_t size() const { return detail::product(shape_); }       ///< Number of elements
+        const std::shared_ptr<const void>& owner() const { return owner_; }  ///< What keeps the elements alive, empty if not owned
+
+        /// Check if the elements follow each other in row-major order
+        bool is_contiguous() const
+        {
+            std::ptrdiff_t stride = 1;
+            for (std::size_t k = dim; k-- > 0;)
+            {
+                if (shape_[k] != 1 && strides_[k] != stride) return false;
+                stride *= static_cast<std::ptrdiff_t>(shape_[k]);
+            }
+            return true;
+        }
+
+        /// Indexing, with negative indices counting from the end
+        template<typename... Indices,
+                 typename std::enable_if<sizeof...(Indices) == dim, int>::type = 0,
+                 typename std::enable_if<conjunction<std::is_integral<Indices>...>::value, int>::type = 0>
+        T& operator()(Indices... indices) const
+        {
+            const long long idx[] = {static_cast<long long>(indices)...};
+
+            std::ptrdiff_t offset = 0;
+            for (std::size_t k = 0; k < dim; ++k)
+            {
+                const long long i = idx[k] < 0 ? idx[k] + static_cast<long long>(shape_[k]) : idx[k];
+                if (i < 0 || static_cast<std::size_t>(i) >= shape_[k]) detail::raise<std::out_of_range>("Index out of range");
+                offset += static_cast<std::ptrdiff_t>(i) * strides_[k];
+            }
+            return data_[offset];
+        }
+
+        /// Unchecked access to the element at `idx`
+        T& get(const std::array<std::size_t, dim>& idx) const
+        {
+            std::ptrdiff_t offset = 0;
+            for (std::size_t k = 0; k < dim; ++k) offset += static_cast<std::ptrdiff_t>(idx[k]) * strides_[k];
+            return data_[offset];
+        }
+
+        /// Copy the elements into a new Inner
+        Inner<dtype, dim> copy() const
+        {
+            detail::OpTimer timer;
+            Inner<dtype, dim> result;
+            detail::evaluate(*this, result);
+            timer.done<dtype>("BufferView::copy", *this);
+            return result;
+        }
+
+        /// Copy when assigned to an Inner
+        operator Inner<dtype, dim>() const
+        {
+            return copy();
+        }
+
+        std::string toString(int indentLevel = 0) const
+        {
+            return copy().toString(indentLevel);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const BufferView& view)
+        {
+            return os << view.toString();
+        }
+
+    private:
+        T* data_;
+        shape_type shape_;
+        strides_type strides_;
+        std::shared_ptr<const void> owner_;
+    };
+
+    template<typename T, std::size_t dim>
+    constexpr std::size_t BufferView<T, dim>::ndim;
+
+    /**
+     * View of `shape` elements at `data` in row-major order, nothing is copied.
+     *
+     * The memory is not owned, it must outlive the view.
+     *
+     * @code
+     * float* pixels = (float*)mmap(...);
+     * auto image = pp::from_buffer<float, 2>(pixels, {height, width});
+     * @endcode
+     */
+    template<typename T, std::size_t dim>
+    BufferView<T, dim> from_buffer(T* data, const std::array<std::size_t, dim>& shape)
+    {
+        return BufferView<T, dim>(data, shape);
+    }
+
+    /// View of the elements at `data`, with `strides` in elements; the memory is not owned
+    template<typename T, std::size_t dim>
+    BufferView<T, dim> from_buffer(T* data, const std::array<std::size_t, dim>& shape, const std::array<std::ptrdiff_t, dim>& strides)
+    {
+        return BufferView<T, dim>(data, shape, strides);
+    }
+
+    /**
+     * Adopt the elements at `data`, with `strides` in elements, nothing is copied.
+     *
+     * `deleter(data)` is called once, when the last view sharing the buffer,
+     * including views converted to const and expressions holding one, is destroyed.
+     *
+     * @code
+     * auto packet = pp::from_buffer<std::uint8_t, 1>(msg.release(), {n}, {1},
+     *                                              [](std::uint8_t* p) { free_message(p); });
+     * @endcode
+     */
+    template<typename T, std::size_t dim, typename Deleter>
+    BufferView<T, dim> from_buffer(T* data, const std::array<std::size_t, dim>& shape, const std::array<std::ptrdiff_t, dim>& strides, Deleter deleter)
+    {
+        return BufferView<T, dim>(data, shape, strides, std::shared_ptr<const void>(data, std::move(deleter)));
+    }
+
+    /** @} */
+
+
+    /**
+     * @addtogroup dynamic Dynamic rank
+     * Arrays whose number of dimensions is only known at run time.
+     *
+     * A DynArray holds its elements contiguously in row-major order, with
+     * its shape in a small vector which only allocates above 6 dimensions.
+     * Its operations run the same kernels as the ones of Inner, over one
+     * flat range of elements, so they are instantiated once per type
+     * instead of once per type and rank.
+     *
+     * Moving an `Inner<T, 1>` into a DynArray, or a DynArray of rank 1 out
+     * into one, moves the storage. Other ranks are copied once, row by row,
+     * as the rows of an Inner are separate vectors.
+     * @{
+     */
+
+    namespace detail
+    {
+        /// A vector which holds up to `N` elements without allocating
+        template<typename T, std::size_t N>
+        class SmallVector
+        {
+        public:
+            SmallVector() : size_(0) {}
+
+            explicit SmallVector(std::size_t n, const T& value = T()) : size_(0)
+            {
+                resize(n, value);
+            }
+
+            SmallVector(std::initializer_list<T> values) : size_(0)
+            {
+                resize(values.size());
+                std::copy(values.begin(), values.end(), begin());
+            }
+
+            template<std::size_t dim>
+            SmallVector(const std::array<T, dim>& values) : size_(0)
+            {
+                resize(dim);
+                std::copy(values.begin(), values.end(), begin());
+            }
+
+            std::size_t size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+
+            T* data() { return size_ <= N ? inline_ : heap_.data(); }
+            const T* data() const { return size_ <= N ? inline_ : heap_.data(); }
+
+            T* begin() { return data(); }
+            T* end() { return data() + size_; }
+            const T* begin() const { return data(); }
+            const T* end() const { return data() + size_; }
+
+            T& operator[](std::size_t i) { return data()[i]; }
+            const T& operator[](std::size_t i) const { return data()[i]; }
+
+            void resize(std::size_t n, const T& value = T())
+            {
+                if (n > N && size_ <= N) heap_.assign(inline_, inline_ + size_);
+                if (n > N) heap_.resize(n, value);
+                else
+                {
+                    if (size_ > N) std::copy(heap_.begin(), heap_.begin() + n, inline_);
+                    else std::fill(inline_ + std::min(size_, n), inline_ + n, value);
+                    heap_.clear();
+                }
+                size_ = n;
+            }
+
+            friend bool operator==(const SmallVector& a, const SmallVector& b)
+            {
+                return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+            }
+
+            friend bool operator!=(const SmallVector& a, const SmallVector& b)
+            {
+                return !(a == b);
+            }
+
+        private:
+            std::size_t size_;
+            T inline_[N];
+            std::vector<T> heap_;
+        };
+
+        template<std::size_t N>
+        std::size_t product(const SmallVector<std::size_t, N>& shape)
+        {
+            std::size_t n = 1;
+            for (std::size_t k = 0; k < shape.size(); ++k) n *= shape[k];
+            return n;
+        }
+
+        /// A contiguous operand of shape `shape`, for the slow operation log
+        template<std::size_t N>
+        SlowOp::Operand describe(const SmallVector<std::size_t, N>& shape)
+        {
+            SlowOp::Operand operand;
+            operand.shape.assign(shape.begin(), shape.end());
+            operand.strides.resize(shape.size());
+
+            std::ptrdiff_t stride = 1;
+            for (std::size_t k = shape.size(); k-- > 0;)
+            {
+                operand.strides[k] = stride;
+                stride *= static_cast<std::ptrdiff_t>(shape[k]);
+            }
+
+            return operand;
+        }
+
+        /// Copy the rows of `arr` to the consecutive rows of `dst`
+        template<typename T>
+        struct FlattenRows
+        {
+            T* dst;
+            void operator()(const Inner<T, 1>& row, std::size_t) { dst = std::copy(row.begin(), row.end(), dst); }
+        };
+
+        /// Copy consecutive rows from `src` to the rows of `arr`
+        template<typename T>
+        void unflatten(Inner<T, 1>& row, const T*& src)
+        {
+            std::copy(src, src + row.size(), row.begin());
+            src += row.size();
+        }
+
+        template<typename T, std::size_t dim>
+        void unflatten(Inner<T, dim>& arr, const T*& src)
+        {
+            for (typename Inner<T, dim>::iterator it = arr.begin(); it != arr.end(); ++it) unflatten(*it, src);
+        }
+
+        /// Inner of shape `shape`, built from the outermost axis in
+        template<typename T>
+        Inner<T, 1> makeInner(const std::size_t* shape, std::integral_constant<std::size_t, 1>)
+        {
+            return Inner<T, 1>(shape[0]);
+        }
+
+        template<typename T, std::size_t dim>
+        Inner<T, dim> makeInner(const std::size_t* shape, std::integral_constant<std::size_t, dim>)
+        {
+            return Inner<T, dim>(shape[0], makeInner<T>(shape + 1, std::integral_constant<std::size_t, dim - 1>()));
+        }
+    }
+
+    /**
+     * An array with a number of dimensions chosen at run time.
+     *
+     * @code
+     * pp::DynArray<float> image = load(path);            // any rank
+     * if (image.ndim() == 3) {
+     *     pp::Inner<float, 3> rgb = image.to_ndarray<3>();
+     * }
+     * float total = pp::sum(image);
+     * @endcode
+     */
+    template<typename T>
+    class DynArray
+    {
+        static_assert(!std::is_same<T, bool>::value, "Use DynArray<std::uint8_t> for booleans");
+
+    public:
+        using dtype = T;                                                ///< Type of the elements
+        using shape_type = detail::SmallVector<std::size_t, 6>;         ///< Length of each axis
+        using strides_type = detail::SmallVector<std::ptrdiff_t, 6>;    ///< Elements between neighbours along each axis
+
+        /// Empty array of one dimension
+        DynArray() : shape_(1, 0) {}
+
+        /// Array of shape `shape` with every element equal to `value`
+        explicit DynArray(const shape_type& shape, const T& value = T()) : shape_(shape), data_(detail::product(shape), value)
+        {
+            if (shape.empty()) detail::raise<std::invalid_argument>("An array has at least one dimension");
+        }
+
+        /// Copy the elements of `arr`
+        template<std::size_t dim>
+        explicit DynArray(const Inner<T, dim>& arr) : shape_(arr.shape()), data_(detail::product(shape_))
+        {
+            detail::FlattenRows<T> flatten = {data_.data()};
+            detail::forEachRow(arr, flatten);
+        }
+
+        /// Take the storage of `arr`, an rvalue `Inner<T, 1>`, without copying
+        template<typename Array, typename = typename std::enable_if<
+                     std::is_base_of<Inner<T, 1>, Array>::value && !std::is_lvalue_reference<Array>::value>::type>
+        explicit DynArray(Array&& arr) : shape_(1, arr.size()), data_(std::move(arr)) {}
+
+        std::size_t ndim() const { return shape_.size(); }              ///< Number of dimensions
+        const shape_type& shape() const { return shape_; }              ///< Length of each axis
+        std::size_t size() const { return data_.size(); }               ///< Number of elements
+
+        /// Elements between neighbours along each axis, in row-major order
+        strides_type strides() const
+        {
+            strides_type result(ndim());
+            std::ptrdiff_t stride = 1;
+            for (std::size_t k = ndim(); k-- > 0;)
+            {
+                result[k] = stride;
+                stride *= static_cast<std::ptrdiff_t>(shape_[k]);
+            }
+            return result;
+        }
+
+        T* data() { return data_.data(); }                              ///< First element, the others follow in row-major order
+        const T* data() const { return data_.data(); }
+
+#if defined(PP_NDARRAY_MDSPAN_NAMESPACE)
+        /**
+         * The elements as an mdspan of `dim` dimensions, nothing is copied.
+         *
+         * @throws std::invalid_argument if ndim() is not `dim`.
+         */
+        template<std::size_t dim>
+        mdspan<T, dim> as_mdspan() { return mdspan<T, dim>(data(), extents<dim>()); }
+
+        template<std::size_t dim>
+        mdspan<const T, dim> as_mdspan() const { return mdspan<const T, dim>(data(), extents<dim>()); }
+#endif
+
+        /**
+         * Indexing, with negative indices counting from the end.
+         *
+         * @throws std::invalid_argument if the number of indices is not ndim().
+         * @throws std::out_of_range if an index is out of range.
+         */
+        template<typename... Indices,
+                 typename std::enable_if<conjunction<std::is_integral<Indices>...>::value, int>::type = 0>
+        T& operator()(Indices... indices)
+        {
+            return data_.data()[offset(indices...)];
+        }
+
+        template<typename... Indices,
+                 typename std::enable_if<conjunction<std::is_integral<Indices>...>::value, int>::type = 0>
+        const T& operator()(Indices... indices) const
+        {
+            return data_.data()[offset(indices...)];
+        }
+
+        /**
+         * Give the array the shape `shape`, keeping its elements in the same order.
+         *
+         * @throws std::invalid_argument if `shape` has another number of elements.
+         */
+        void reshape(const shape_type& shape)
+        {
+            if (shape.empty() || detail::product(shape) != size()) detail::raise<std::invalid_argument>("Cannot reshape to a different size");
+            shape_ = shape;
+        }
+
+        /**
+         * Copy into an Inner of `dim` dimensions.
+         *
+         * @throws std::invalid_argument if ndim() is not `dim`.
+         */
+        template<std::size_t dim>
+        Inner<T, dim> to_ndarray() const &
+        {
+            if (ndim() != dim) detail::raise<std::invalid_argument>("Wrong number of dimensions");
+
+            Inner<T, dim> result = detail::makeInner<T>(shape_.data(), std::integral_constant<std::size_t, dim>());
+            const T* src = data_.data();
+            detail::unflatten(result, src);
+            return result;
+        }
+
+        /// Move into an Inner, without copying when `dim` is 1
+        template<std::size_t dim>
+        Inner<T, dim> to_ndarray() &&
+        {
+            return moveTo(std::integral_constant<std::size_t, dim>());
+        }
+
+        std::string toString(int indentLevel = 0) const
+        {
+            std::stringstream ss;
+            print(ss, 0, 0, indentLevel);
+            return ss.str();
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const DynArray& arr)
+        {
+            return os << arr.toString();
+        }
+
+    private:
+        shape_type shape_;
+        BaseVector<T> data_;
+
+        template<std::size_t dim>
+        std::array<std::size_t, dim> extents() const
+        {
+            if (ndim() != dim) detail::raise<std::invalid_argument>("Wrong number of dimensions");
+
+            std::array<std::size_t, dim> result;
+            std::copy(shape_.begin(), shape_.end(), result.begin());
+            return result;
+        }
+
+        template<typename... Indices>
+        std::size_t offset(Indices... indices) const
+        {
+            if (sizeof...(Indices) != ndim()) detail::raise<std::invalid_argument>("Wrong number of indices");
+
+            const long long raw[] = {static_cast<long long>(indices)..., 0};
+            std::size_t result = 0;
+            for (std::size_t k = 0; k < sizeof...(Indices); ++k)
+            {
+                const long long i = raw[k] < 0 ? raw[k] + static_cast<long long>(shape_[k]) : raw[k];
+                if (i < 0 || static_cast<std::size_t>(i) >= shape_[k]) detail::raise<std::out_of_range>("Index out of range");
+                result = result * shape_[k] + static_cast<std::size_t>(i);
+            }
+            return result;
+        }
+
+        Inner<T, 1> moveTo(std::integral_constant<std::size_t, 1>)
+        {
+            if (ndim() != 1) detail::raise<std::invalid_argument>("Wrong number of dimensions");
+
+            Inner<T, 1> result;
+            result.swap(data_);
+            shape_ = shape_type(1, 0);
+            return result;
+        }
+
+        template<std::size_t dim>
+        Inner<T, dim> moveTo(std::integral_constant<std::size_t, dim>)
+        {
+            return static_cast<const DynArray&>(*this).to_ndarray<dim>();
+        }
+
+        /// Print the elements of axis `k` from `offset`, in the format of Inner::toString()
+        void print(std::ostream& os, std::size_t k, std::size_t offset, int indentLevel) const
+        {
+            const std::size_t n = shape_[k];
+            if (n == 0)
+            {
+                os << "[ ]";
+                return;
+            }
+
+            std::size_t stride = 1;
+            for (std::size_t j = k + 1; j < ndim(); ++j) stride *= shape_[j];
+
+            if (k + 1 == ndim())
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                    os << (i == 0 ? "[ " : "") << data_.data()[offset + i] << (i != n - 1 ? ", " : " ]");
+                return;
+            }
+
+            const std::string indent(indentLevel * 2, ' ');
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                os << (i == 0 ? "[\n" : "") << indent << "  ";
+                print(os, k + 1, offset + i * stride, indentLevel + 1);
+                os << (i != n - 1 ? "," : "") << "\n";
+            }
+            os << indent << "]";
+        }
+    };
+
+    /// Set every element of `arr` to `value`
+    template<typename T>
+    void fill(DynArray<T>& arr, const T& value)
+    {
+        detail::OpTimer timer;
+        if (detail::streaming<T>(arr.size()))
+        {
+            detail::streamFill(arr.data(), value, arr.size());
+            detail::streamFence();
+        }
+        else std::fill_n(arr.data(), arr.size(), value);
+        timer.done<T>("fill", arr);
+    }
+
+    /**
+     * Copy the elements of `src` into `dst`, which keeps its storage.
+     *
+     * @throws std::invalid_argument if the shapes differ.
+     */
+    template<typename T>
+    void copyto(DynArray<T>& dst, const DynArray<T>& src)
+    {
+        detail::OpTimer timer;
+        if (dst.shape() != src.shape()) detail::raise<std::invalid_argument>("Shape mismatch");
+
+        if (detail::streaming<T>(src.size()))
+        {
+            detail::streamCopy(dst.data(), src.data(), src.size());
+            detail::streamFence();
+        }
+        else std::copy(src.data(), src.data() + src.size(), dst.data());
+        timer.done<T>("copyto", src, dst);
+    }
+
+    /// Sum of all the elements of `arr`
+    template<typename T>
+    T sum(const DynArray<T>& arr)
+    {
+        detail::OpTimer timer;
+        const T total = detail::sum(arr.data(), arr.size());
+        timer.done<T>("sum", arr);
+        return total;
+    }
+
+    /// Number of nonzero elements of `arr`
+    template<typename T>
+    std::size_t count_nonzero(const DynArray<T>& arr)
+    {
+        detail::OpTimer timer;
+        const std::size_t count = detail::countNonzero(arr.data(), arr.size());
+        timer.done<T>("count_nonzero", arr);
+        return count;
+    }
+
+    /** @} */
+
+
+#if defined(EIGEN_WORLD_VERSION)
+    /**
+     * @addtogroup eigen Eigen
+     * Eigen maps of the arrays, and views of Eigen matrices.
+     *
+     * Contiguous elements, those of an `Inner<T, 1>`, of a DynArray of one
+     * or two dimensions or of a BufferView, are mapped with `Eigen::Map`
+     * without being copied. The rows of an Inner of more dimensions are
+     * separate vectors, which a Map cannot describe: map its rows one by
+     * one, or move the array into a DynArray.
+     *
+     * Enabled when Eigen is included before ndarray-11.hpp, or when
+     * PP_NDARRAY_EIGEN is defined and `<Eigen/Core>` is found.
+     *
+     * @code
+     * pp::DynArray<double> a({3, 3}, 1.0);
+     * Eigen::MatrixXd inv = pp::eigen::map(a).inverse();   // no copy of a
+     * pp::Ndarray<double[2]> b = pp::eigen::view(inv);     // one copy, no loop over operator()
+     * @endcode
+     * @{
+     */
+
+    namespace detail
+    {
+        /// Rows and columns of the matrix a DynArray of shape `shape` maps to
+        inline std::array<Eigen::Index, 2> eigenShape(const SmallVector<std::size_t, 6>& shape)
+        {
+            if (shape.size() > 2) raise<std::invalid_argument>("Only arrays of one or two dimensions map to a matrix");
+            return {{static_cast<Eigen::Index>(shape[0]), static_cast<Eigen::Index>(shape.size() == 2 ? shape[1] : 1)}};
+        }
+
+        /// Stride of `view` along `axis`, Eigen only takes non-negative ones
+        template<typename T, std::size_t dim>
+        Eigen::Index eigenStride(const BufferView<T, dim>& view, std::size_t axis)
+        {
+            if (view.strides()[axis] < 0) raise<std::invalid_argument>("Eigen strides cannot be negative");
+            return static_cast<Eigen::Index>(view.strides()[axis]);
+        }
+    }
+
+    namespace eigen
+    {
+        /// Column vector of `T`, const if `T` is
+        template<typename T>
+        using Vector = typename std::conditional<std::is_const<T>::value,
+                           const Eigen::Matrix<typename std::remove_const<T>::type, Eigen::Dynamic, 1>,
+                           Eigen::Matrix<T, Eigen::Dynamic, 1>>::type;
+
+        /// Row-major matrix of `T`, const if `T` is
+        template<typename T>
+        using Matrix = typename std::conditional<std::is_const<T>::value,
+                           const Eigen::Matrix<typename std::remove_const<T>::type, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>,
+                           Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>::type;
+
+        /// Alignment of the elements of an Inner or a DynArray, which come from operator new
+        constexpr int alignment = alignof(std::max_align_t) >= 16 ? Eigen::Aligned16 : Eigen::Unaligned;
 
+        /// The elements of `arr` as a column vector
+        template<typename T>
+        Eigen::Map<Vector<T>, alignment> map(Inner<T, 1>& arr)
+        {
+            return Eigen::Map<Vector<T>, alignment>(arr.data(), static_cast<Eigen::Index>(arr.size()));
+        }
 
-    /// Class with common methods
-    template< typename Dtype, typename Allocator = std::allocator<Dtype> >
-    struct BaseVector : public std::vector<Dtype, Allocator>
-    {
-        using std::vector<Dtype, Allocator>::vector;
-        ~BaseVector() = default;
+        template<typename T>
+        Eigen::Map<Vector<const T>, alignment> map(const Inner<T, 1>& arr)
+        {
+            return Eigen::Map<Vector<const T>, alignment>(arr.data(), static_cast<Eigen::Index>(arr.size()));
+        }
 
-        // toString for types that are arithmetic or std::string
-        template <typename U = Dtype>
-        auto toString(int indentLevel = 0) const -> 
-        typename std::enable_if<std::integral_constant<bool, std::is_arithmetic<U>::value || std::is_same<U, std::string>::value>::value, std::string>::type
+        /**
+         * The elements of `arr` as a row-major matrix, of one column if `arr` has one dimension.
+         *
+         * @throws std::invalid_argument if `arr` has more than two dimensions.
+         */
+        template<typename T>
+        Eigen::Map<Matrix<T>, alignment> map(DynArray<T>& arr)
         {
-            if (this->empty()) return "[ ]";
-            std::stringstream ss;
-            for (size_t i = 0; i < this->size(); ++i) {
-                ss << (i==0? "[ ": "")
-                   << this->at(i)
-                   << (i != this->size()-1 ? ", " : " ]");
-            }
-            return ss.str();
+            const std::array<Eigen::Index, 2> shape = detail::eigenShape(arr.shape());
+            return Eigen::Map<Matrix<T>, alignment>(arr.data(), shape[0], shape[1]);
         }
 
-        // toString for types that have toString() method
-        template <typename U = Dtype>
-        auto toString(int indentLevel = 0) const ->
-        decltype(std::declval<U>().toString())
+        template<typename T>
+        Eigen::Map<Matrix<const T>, alignment> map(const DynArray<T>& arr)
         {
-            if (this->empty()) return "[ ]";
-            std::stringstream ss;
-            std::string indent(indentLevel * 2, ' ');
-            for (size_t i = 0; i < this->size(); ++i) {
-                // Recursive call for nested vectors
-                ss << (i==0? "[\n": "")
-                   << indent
-                   << "  " << (*this)[i].toString(indentLevel + 1)
-                   << (i != this->size()-1 ? "," : "")
-                   << "\n";
-            }
-            ss << indent << "]";
-            return ss.str();
+            const std::array<Eigen::Index, 2> shape = detail::eigenShape(arr.shape());
+            return Eigen::Map<Matrix<const T>, alignment>(arr.data(), shape[0], shape[1]);
         }
 
-        Dtype& at(int idx)
+        /**
+         * The elements of `view` as a column vector.
+         *
+         * @throws std::invalid_argument if the stride is negative.
+         */
+        template<typename T>
+        Eigen::Map<Vector<T>, Eigen::Unaligned, Eigen::InnerStride<>> map(const BufferView<T, 1>& view)
         {
-            if (idx < 0 ) {
-                idx += this->size();
-                if (idx < 0) throw std::out_of_range("Index out of range");
-            }
+            return Eigen::Map<Vector<T>, Eigen::Unaligned, Eigen::InnerStride<>>(
+                view.data(), static_cast<Eigen::Index>(view.size()), Eigen::InnerStride<>(detail::eigenStride(view, 0)));
+        }
 
-            return std::vector<Dtype>::at(idx);
+        /**
+         * The elements of `view` as a row-major matrix.
+         *
+         * @throws std::invalid_argument if a stride is negative.
+         */
+        template<typename T>
+        Eigen::Map<Matrix<T>, Eigen::Unaligned, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>> map(const BufferView<T, 2>& view)
+        {
+            return Eigen::Map<Matrix<T>, Eigen::Unaligned, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>>(
+                view.data(), static_cast<Eigen::Index>(view.shape()[0]), static_cast<Eigen::Index>(view.shape()[1]),
+                Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>(detail::eigenStride(view, 0), detail::eigenStride(view, 1)));
         }
 
-        const Dtype& at(int idx) const 
+        /**
+         * View of the elements of an Eigen matrix, vector, block or map, nothing is copied.
+         *
+         * The view is read-only for a const or read-only object. A temporary
+         * block or map may be viewed, a temporary matrix or array may not.
+         */
+        template<typename Derived>
+        BufferView<typename std::remove_pointer<decltype(std::declval<Derived&>().data())>::type, 2> view(Eigen::DenseBase<Derived>& m)
         {
-            if (idx < 0 ) {
-                idx += this->size();
-                if (idx < 0) throw std::out_of_range("Index out of range");
-            }
+            static_assert(int(Derived::Flags) & int(Eigen::DirectAccessBit), "Only Eigen objects with storage can be viewed, evaluate expressions first");
 
-            return std::vector<Dtype>::at(idx);
+            return {m.derived().data(), {{static_cast<std::size_t>(m.rows()), static_cast<std::size_t>(m.cols())}},
+                    {{m.derived().rowStride(), m.derived().colStride()}}};
         }
 
-        friend std::ostream& operator<<(std::ostream& os, const BaseVector<Dtype, Allocator>& vec)
+        template<typename Derived>
+        BufferView<const typename Derived::Scalar, 2> view(const Eigen::DenseBase<Derived>& m)
         {
-            return os << vec.toString();
+            static_assert(int(Derived::Flags) & int(Eigen::DirectAccessBit), "Only Eigen objects with storage can be viewed, evaluate expressions first");
+
+            return {m.derived().data(), {{static_cast<std::size_t>(m.rows()), static_cast<std::size_t>(m.cols())}},
+                    {{m.derived().rowStride(), m.derived().colStride()}}};
         }
 
+        /// A matrix or array which owns its elements would be destroyed before its view is used
+        template<typename Derived, typename = typename std::enable_if<std::is_base_of<Eigen::PlainObjectBase<Derived>, Derived>::value>::type>
+        void view(Eigen::DenseBase<Derived>&&) = delete;
+    }
+
+    /** @} */
+#endif
 
-    };
 
     /**
-     * @addtogroup inner Inner
-     * Implementation of Ndarray.
+     * @addtogroup any Type erased arrays
+     * Arrays whose type of elements is only known at run time.
+     *
+     * An AnyArray holds a DynArray of one of the ScalarType types. Its
+     * operations look up the table of kernels of its type and call them
+     * through function pointers, so code which only handles AnyArray
+     * instantiates the kernels once per scalar type, whatever the number of
+     * types and ranks its data has.
      * @{
      */
-    
-    /// Class for multi-dimensional array
-    // primary template
-    template<typename Dtype, std::size_t dim>
-    struct Inner : public BaseVector<Inner<Dtype, dim - 1>>
-    {
-        static_assert(dim >= 1, "Dimension must be greater than zero!");
 
-        // Construct in Recursive
-        template<typename... Args>
-        Inner(std::size_t n = 0, Args... args) : BaseVector<Inner<Dtype, dim - 1>>(n, Inner<Dtype, dim - 1>(args...))
-        {}
+    /// Calls `X(name, type)` for each ScalarType
+#define PP_NDARRAY_SCALAR_TYPES(X)  \
+    X(int8, std::int8_t)            \
+    X(int16, std::int16_t)          \
+    X(int32, std::int32_t)          \
+    X(int64, std::int64_t)          \
+    X(uint8, std::uint8_t)          \
+    X(uint16, std::uint16_t)        \
+    X(uint32, std::uint32_t)        \
+    X(uint64, std::uint64_t)        \
+    X(float32, float)               \
+    X(float64, double)
 
-        /// Constructor to handle initializer list for nested lists
-        Inner(std::initializer_list<Inner<Dtype, dim - 1>> initList) : BaseVector<Inner<Dtype, dim - 1>>(initList)
-        {}
+    /// Type of the elements of an AnyArray, named after NumPy's dtypes
+    enum class ScalarType
+    {
+#define PP_NDARRAY_ENUMERATOR(name, type) name,
+        PP_NDARRAY_SCALAR_TYPES(PP_NDARRAY_ENUMERATOR)
+#undef PP_NDARRAY_ENUMERATOR
+    };
 
-        /// Copy from lower dimension
-        template<typename T, std::size_t M, typename = typename std::enable_if<(M < dim)>::type>
-        Inner(const Inner<T, M>& lowerDimInner)
+    /// ScalarType of `T`, if it has one
+    template<typename T> struct scalar_type_of;
+#define PP_NDARRAY_SCALAR_TYPE_OF(name, type) \
+    template<> struct scalar_type_of<type> : std::integral_constant<ScalarType, ScalarType::name> {};
+    PP_NDARRAY_SCALAR_TYPES(PP_NDARRAY_SCALAR_TYPE_OF)
+#undef PP_NDARRAY_SCALAR_TYPE_OF
+
+    /**
+     * A number of one of the ScalarType types.
+     *
+     * Integers are held as 64 bit integers, and floating point numbers as
+     * double; type() is the type the value came from.
+     */
+    class AnyScalar
+    {
+    public:
+        template<typename T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+        AnyScalar(T value) : type_(typeOf<T>()), f_(0)
         {
-            this->push_back(Inner<T, dim - 1>(lowerDimInner));
+            if (std::is_floating_point<T>::value) f_ = static_cast<double>(value);
+            else if (std::is_signed<T>::value) i_ = static_cast<std::int64_t>(value);
+            else u_ = static_cast<std::uint64_t>(value);
         }
 
-        /**
-         * @name Indexing
-         *
-         * Indexing for Ndarray
-         * Unlike Slicing, Indexing returns a reference to the element.
-         */
-        
-        template<typename... Indices,
-                 typename std::enable_if<(sizeof...(Indices) > 0), int>::type = 0,
-                 typename std::enable_if<conjunction<std::is_integral<Indices>...>::value, int>::type = 0>
-        auto operator()(int idx, Indices... indices) -> decltype(this->at(idx)(indices...)) 
+        ScalarType type() const { return type_; }   ///< Type the value came from
+
+        /// The value converted to `T`
+        template<typename T>
+        T as() const
         {
-            return this->at(idx).operator()(indices...);
+            switch (type_)
+            {
+            case ScalarType::float32:
+            case ScalarType::float64: return static_cast<T>(f_);
+            case ScalarType::uint8:
+            case ScalarType::uint16:
+            case ScalarType::uint32:
+            case ScalarType::uint64: return static_cast<T>(u_);
+            default: return static_cast<T>(i_);
+            }
         }
 
-        template<typename... Indices,
-                 typename std::enable_if<(sizeof...(Indices) > 0), int>::type = 0,
-                 typename std::enable_if<conjunction<std::is_integral<Indices>...>::value, int>::type = 0>
-        const Inner<Dtype, dim-1>& operator()(int idx, Indices... indices) const
+        friend std::ostream& operator<<(std::ostream& os, const AnyScalar& value)
         {
-            return this->at(idx).operator()(indices...);
+            switch (value.type_)
+            {
+            case ScalarType::float32:
+            case ScalarType::float64: return os << value.f_;
+            case ScalarType::uint8:
+            case ScalarType::uint16:
+            case ScalarType::uint32:
+            case ScalarType::uint64: return os << value.u_;
+            default: return os << value.i_;
+            }
         }
 
-        // For when there is only one index
-        Inner<Dtype, dim-1>& operator()(int idx)
+    private:
+        ScalarType type_;
+        union
         {
-            return this->at(idx);
-        }
+            std::int64_t i_;
+            std::uint64_t u_;
+            double f_;
+        };
 
-        const Inner<Dtype, dim-1>& operator()(int idx) const
+        /// The ScalarType of `T`, or of the integer of the same size and sign for types like `long long` or `char`
+        template<typename T>
+        static ScalarType typeOf()
         {
-            return this->at(idx);
+            if (std::is_floating_point<T>::value) return sizeof(T) == 4 ? ScalarType::float32 : ScalarType::float64;
+
+            const unsigned log = sizeof(T) == 1 ? 0 : sizeof(T) == 2 ? 1 : sizeof(T) == 4 ? 2 : 3;
+            return static_cast<ScalarType>((std::is_signed<T>::value ? 0 : 4) + log);
         }
+    };
+
+    namespace detail
+    {
+        using AnyShape = DynArray<double>::shape_type;
 
         /**
-         * @name Slicing
-         * 
-         * Slicing index for Ndarray
-         * Unlike Indexing, Slicing returns a new Ndarray.
+         * Kernels of one ScalarType.
+         *
+         * The arrays they take are `DynArray<T>*` of that type; binary
+         * kernels take operands of the same type and shape.
          */
-        
-        Inner<Dtype, dim> operator[](const std::string& input) const
+        struct AnyKernels
         {
-            std::string str(input);
+            ScalarType type;
+            std::size_t itemsize;
 
-            std::array<Range, dim> slices;
-            std::size_t i = 0;
+            void* (*make)(const AnyShape& shape);
+            void* (*clone)(const void* arr);
+            void (*destroy)(void* arr);
+            const AnyShape& (*shape)(const void* arr);
+            void* (*data)(const void* arr);
+            void (*reshape)(void* arr, const AnyShape& shape);
+            std::string (*toString)(const void* arr, int indentLevel);
 
-            std::regex re("\\s*,\\s*");
-            std::sregex_token_iterator first{str.begin(), str.end(), re, -1}, last;
-            for (; first != last; ++first) {
-                if(i >= dim) throw std::invalid_argument("Too many slices");
-                slices[i++] = Range::parseRange(*first);
-            }
+            void (*fill)(void* arr, const AnyScalar& value);
+            void (*copyto)(void* dst, const void* src);
+            void (*binary[4])(const void* a, const void* b, void* out);     ///< Indexed by BinaryOp
+            AnyScalar (*sum)(const void* arr);
+            AnyScalar (*min)(const void* arr);
+            AnyScalar (*max)(const void* arr);
+            std::size_t (*count_nonzero)(const void* arr);
 
-            return slice(slices, 0, i);
-        }
+            /// Convert the elements of `from` into `to`, an array of the same shape and of the type of the index
+            void (*convert[10])(const void* from, void* to);
+        };
 
+        /// Index of the binary kernels
+        enum BinaryOp { add, subtract, multiply, divide };
 
-        template<std::size_t length>
-        Inner<Dtype, dim> slice(const std::array<Range, length> slices, int start, const int& end) const
+        template<typename T>
+        struct AnyKernelsOf
         {
-            if(start == end) return *this;
+            static DynArray<T>& array(void* arr) { return *static_cast<DynArray<T>*>(arr); }
+            static const DynArray<T>& array(const void* arr) { return *static_cast<const DynArray<T>*>(arr); }
 
-            Inner<Dtype, dim> result;
+            static void* make(const AnyShape& shape) { return new DynArray<T>(shape); }
+            static void* clone(const void* arr) { return new DynArray<T>(array(arr)); }
+            static void destroy(void* arr) { delete &array(arr); }
+            static const AnyShape& shape(const void* arr) { return array(arr).shape(); }
+            static void* data(const void* arr) { return const_cast<T*>(array(arr).data()); }
+            static void reshape(void* arr, const AnyShape& shape) { array(arr).reshape(shape); }
+            static std::string toString(const void* arr, int indentLevel) { return array(arr).toString(indentLevel); }
 
-            Range r = slices[start];
-            std::size_t stop = r.has_stop? r.stop: this->size();
+            static void fill(void* arr, const AnyScalar& value) { pp::fill(array(arr), value.as<T>()); }
+            static void copyto(void* dst, const void* src) { pp::copyto(array(dst), array(src)); }
 
-            for(int i = r.start; i < stop; i += r.step)
+            template<typename Op>
+            static void binary(const void* a, const void* b, void* out)
             {
-                result.push_back(this->at(i).slice(slices, start + 1, end));
+                const T* x = array(a).data();
+                const T* y = array(b).data();
+                T* z = array(out).data();
+                const Op op = Op();
+                for (std::size_t j = 0, n = array(out).size(); j < n; ++j) z[j] = static_cast<T>(op(x[j], y[j]));
             }
 
-            return result;
+            /// Sum in a 64 bit integer or in T, like `numpy.sum()`
+            static AnyScalar sum(const void* arr)
+            {
+                using Total = typename std::conditional<std::is_floating_point<T>::value, T,
+                              typename std::conditional<std::is_signed<T>::value, std::int64_t, std::uint64_t>::type>::type;
+
+                const T* first = array(arr).data();
+                Total total = Total();
+                for (std::size_t j = 0, n = array(arr).size(); j < n; ++j) total += first[j];
+                return total;
+            }
+
+            static AnyScalar min(const void* arr)
+            {
+                if (array(arr).size() == 0) raise<std::invalid_argument>("Reduction of an empty array");
+                return *std::min_element(array(arr).data(), array(arr).data() + array(arr).size());
+            }
+
+            static AnyScalar max(const void* arr)
+            {
+                if (array(arr).size() == 0) raise<std::invalid_argument>("Reduction of an empty array");
+                return *std::max_element(array(arr).data(), array(arr).data() + array(arr).size());
+            }
+
+            static std::size_t count_nonzero(const void* arr) { return pp::count_nonzero(array(arr)); }
+
+            template<typename U>
+            static void convert(const void* from, void* to)
+            {
+                const T* x = array(from).data();
+                U* y = static_cast<DynArray<U>*>(to)->data();
+                for (std::size_t j = 0, n = array(from).size(); j < n; ++j) y[j] = static_cast<U>(x[j]);
+            }
+
+            static const AnyKernels& table()
+            {
+                static const AnyKernels kernels = {
+                    scalar_type_of<T>::value, sizeof(T),
+                    make, clone, destroy, shape, data, reshape, toString,
+                    fill, copyto,
+                    {binary<Plus>, binary<Minus>, binary<Multiplies>, binary<Divides>},
+                    sum, min, max, count_nonzero,
+                    {
+#define PP_NDARRAY_CONVERT(name, type) convert<type>,
+                        PP_NDARRAY_SCALAR_TYPES(PP_NDARRAY_CONVERT)
+#undef PP_NDARRAY_CONVERT
+                    }
+                };
+                return kernels;
+            }
+        };
+
+        /// Kernels of `type`
+        inline const AnyKernels& anyKernels(ScalarType type)
+        {
+            switch (type)
+            {
+#define PP_NDARRAY_KERNELS(name, type) case ScalarType::name: return AnyKernelsOf<type>::table();
+                PP_NDARRAY_SCALAR_TYPES(PP_NDARRAY_KERNELS)
+#undef PP_NDARRAY_KERNELS
+            }
+            raise<std::invalid_argument>("Unknown scalar type");
         }
-    };
-    
-    /// Class for 1-dimensional array
-    // partial specialization where dimension is 1
-    template<typename Dtype>
-    struct Inner<Dtype, 1> : public BaseVector<Dtype>
+    }
+
+    /// NumPy name of `type`, e.g. "float32"
+    inline const char* scalar_type_name(ScalarType type)
     {
-        Inner(std::size_t n = 0, const Dtype& val = Dtype{}) : BaseVector<Dtype>(n, val)
-        {}
+        switch (type)
+        {
+#define PP_NDARRAY_NAME(name, type) case ScalarType::name: return #name;
+            PP_NDARRAY_SCALAR_TYPES(PP_NDARRAY_NAME)
+#undef PP_NDARRAY_NAME
+        }
+        return "unknown";
+    }
 
-        Inner(std::initializer_list<Dtype> initList) : BaseVector<Dtype>(initList)
-        {}
+    /**
+     * An array with the type of its elements and its number of dimensions chosen at run time.
+     *
+     * @code
+     * pp::AnyArray a(pp::ScalarType::float32, {2, 3});
+     * pp::fill(a, 1.5);
+     * pp::AnyArray b = (a + a).astype(pp::ScalarType::int64);
+     * std::cout << pp::sum(b) << std::endl;                   // 18
+     * pp::DynArray<std::int64_t>& values = b.as<std::int64_t>();
+     * @endcode
+     */
+    class AnyArray
+    {
+    public:
+        using shape_type = detail::AnyShape;
 
-        /* Indexing */
-        Dtype& operator()(int idx) {
-            return this->at(idx);
+        /// Empty float64 array of one dimension
+        AnyArray() : AnyArray(ScalarType::float64, shape_type(1, 0)) {}
+
+        /// Array of `type` and shape `shape`, filled with zeros
+        AnyArray(ScalarType type, const shape_type& shape) : kernels_(&detail::anyKernels(type)), array_(kernels_->make(shape)) {}
+
+        /// Take `arr`, without copying its elements when it is an rvalue
+        template<typename T>
+        explicit AnyArray(DynArray<T> arr) : kernels_(&detail::AnyKernelsOf<T>::table()), array_(new DynArray<T>(std::move(arr))) {}
+
+        /// Copy the elements of `arr`
+        template<typename T, std::size_t dim>
+        explicit AnyArray(const Inner<T, dim>& arr) : AnyArray(DynArray<T>(arr)) {}
+
+        AnyArray(const AnyArray& other) : kernels_(other.kernels_), array_(other.kernels_->clone(other.array_)) {}
+
+        /// Take the elements of `other`, which is left an empty array of its type
+        AnyArray(AnyArray&& other) noexcept : kernels_(other.kernels_), array_(other.array_)
+        {
+            other.array_ = other.kernels_->make(shape_type(1, 0));
         }
 
-        const Dtype& operator()(int idx) const {
-            return this->at(idx);
+        AnyArray& operator=(AnyArray other) noexcept
+        {
+            std::swap(kernels_, other.kernels_);
+            std::swap(array_, other.array_);
+            return *this;
         }
 
-        /* Slicing */
-        Inner<Dtype, 1> operator[](const std::string& input) const
+        ~AnyArray()
         {
-            std::string str(input);
-            std::array<Range, 1> slices;
+            kernels_->destroy(array_);
+        }
+
+        ScalarType dtype() const { return kernels_->type; }                    ///< Type of the elements
+        std::size_t itemsize() const { return kernels_->itemsize; }            ///< Bytes of an element
+        const shape_type& shape() const { return kernels_->shape(array_); }    ///< Length of each axis
+        std::size_t ndim() const { return shape().size(); }                     ///< Number of dimensions
+        std::size_t size() const { return detail::product(shape()); }          ///< Number of elements
 
-            Range range = Range::parseRange(str);
-            slices[0] = range;
+        void* data() { return kernels_->data(array_); }                        ///< First element, the others follow in row-major order
+        const void* data() const { return kernels_->data(array_); }
 
-            return slice(slices);
+        /// Whether the elements are of type `T`
+        template<typename T>
+        bool is() const
+        {
+            return kernels_ == &detail::AnyKernelsOf<T>::table();
         }
 
-        template<std::size_t length>
-        Inner<Dtype, 1> slice(const std::array<Range, length> slices, int start, const int& end) const
+        /**
+         * The array of elements of type `T`.
+         *
+         * @throws std::invalid_argument if the elements are of another type.
+         */
+        template<typename T>
+        DynArray<T>& as()
         {
-            if(start == end) return *this;
+            if (!is<T>()) detail::raise<std::invalid_argument>("Wrong scalar type");
+            return *static_cast<DynArray<T>*>(array_);
+        }
 
-            Inner<Dtype, 1> result;
+        template<typename T>
+        const DynArray<T>& as() const
+        {
+            if (!is<T>()) detail::raise<std::invalid_argument>("Wrong scalar type");
+            return *static_cast<const DynArray<T>*>(array_);
+        }
 
-            Range s = slices[start];
-            std::size_t stop = s.has_stop? s.stop: this->size();
+        /// Copy of the array with elements converted to `type`, like `numpy.astype()`
+        AnyArray astype(ScalarType type) const
+        {
+            AnyArray result(type, shape());
+            kernels_->convert[static_cast<int>(type)](array_, result.array_);
+            return result;
+        }
 
-            for(int i = s.start; i < stop; i += s.step)
-            {
-                result.push_back(this->at(i));
-            }
+        /// @copydoc DynArray::reshape
+        void reshape(const shape_type& shape)
+        {
+            kernels_->reshape(array_, shape);
+        }
+
+        std::string toString(int indentLevel = 0) const
+        {
+            return kernels_->toString(array_, indentLevel);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const AnyArray& arr)
+        {
+            return os << arr.toString();
+        }
+
+    private:
+        const detail::AnyKernels* kernels_;
+        void* array_;
+
+        /**
+         * Element-wise `op` of two arrays of the same type and shape.
+         *
+         * @throws std::invalid_argument if the types or the shapes differ.
+         */
+        static AnyArray binary(detail::BinaryOp op, const AnyArray& a, const AnyArray& b)
+        {
+            if (a.dtype() != b.dtype()) detail::raise<std::invalid_argument>("Scalar types differ, convert one with astype()");
+            if (a.shape() != b.shape()) detail::raise<std::invalid_argument>("Shape mismatch");
 
+            AnyArray result(a.dtype(), a.shape());
+            a.kernels_->binary[op](a.array_, b.array_, result.array_);
             return result;
         }
 
+        friend AnyArray operator+(const AnyArray& a, const AnyArray& b) { return binary(detail::add, a, b); }        ///< @copydoc binary
+        friend AnyArray operator-(const AnyArray& a, const AnyArray& b) { return binary(detail::subtract, a, b); }   ///< @copydoc binary
+        friend AnyArray operator*(const AnyArray& a, const AnyArray& b) { return binary(detail::multiply, a, b); }   ///< @copydoc binary
+        friend AnyArray operator/(const AnyArray& a, const AnyArray& b) { return binary(detail::divide, a, b); }     ///< @copydoc binary
+
+        friend void fill(AnyArray& arr, const AnyScalar& value);
+        friend void copyto(AnyArray& dst, const AnyArray& src);
+        friend AnyScalar sum(const AnyArray& arr);
+        friend AnyScalar min(const AnyArray& arr);
+        friend AnyScalar max(const AnyArray& arr);
+        friend std::size_t count_nonzero(const AnyArray& arr);
     };
+
+    /// Set every element of `arr` to `value`, converted to the type of `arr`
+    inline void fill(AnyArray& arr, const AnyScalar& value)
+    {
+        arr.kernels_->fill(arr.array_, value);
+    }
+
+    /**
+     * Copy the elements of `src` into `dst`, which keeps its storage.
+     *
+     * @throws std::invalid_argument if the types or the shapes differ.
+     */
+    inline void copyto(AnyArray& dst, const AnyArray& src)
+    {
+        if (dst.dtype() != src.dtype()) detail::raise<std::invalid_argument>("Scalar types differ, convert one with astype()");
+        dst.kernels_->copyto(dst.array_, src.array_);
+    }
+
+    /// Sum of all the elements of `arr`, in a 64 bit integer for integer types
+    inline AnyScalar sum(const AnyArray& arr)
+    {
+        return arr.kernels_->sum(arr.array_);
+    }
+
+    /**
+     * Smallest element of `arr`.
+     *
+     * @throws std::invalid_argument if `arr` is empty.
+     */
+    inline AnyScalar min(const AnyArray& arr)
+    {
+        return arr.kernels_->min(arr.array_);
+    }
+
+    /**
+     * Largest element of `arr`.
+     *
+     * @throws std::invalid_argument if `arr` is empty.
+     */
+    inline AnyScalar max(const AnyArray& arr)
+    {
+        return arr.kernels_->max(arr.array_);
+    }
+
+    /// Number of nonzero elements of `arr`
+    inline std::size_t count_nonzero(const AnyArray& arr)
+    {
+        return arr.kernels_->count_nonzero(arr.array_);
+    }
+
     /** @} */
 
 
@@ -392,6 +6681,74 @@ namespace pp
     };
 
     /** @} */
+
+
+#if defined(PP_NDARRAY_INSTANTIATE) || defined(PP_NDARRAY_EXTERN_TEMPLATES)
+    /**
+     * @addtogroup instantiation Explicit instantiation
+     * Instantiate the common arrays once for the whole program.
+     *
+     * Each translation unit using `Inner<T, 3>` instantiates `Inner<T, 2>`
+     * and `Inner<T, 1>` too, with their BaseVector, toString() and
+     * kernels, and the linker then throws all the copies but one away.
+     * With PP_NDARRAY_EXTERN_TEMPLATES defined, the arrays of one to three
+     * dimensions of each ScalarType, their DynArray and AnyArray kernels,
+     * and fill(), copyto(), sum(), count_nonzero() and matmul() on them,
+     * are only declared; src/ndarray-11.cpp instantiates them.
+     *
+     * The library must be compiled with the same `PP_NDARRAY_*` macros as
+     * the code using it. Other types and ranks are still instantiated where
+     * they are used.
+     * @{
+     */
+
+#if defined(PP_NDARRAY_INSTANTIATE)
+#define PP_NDARRAY_EXTERN
+#else
+#define PP_NDARRAY_EXTERN extern
+#endif
+
+#define PP_NDARRAY_INSTANTIATE_VECTOR(...)                                                           \
+    PP_NDARRAY_EXTERN template struct BaseVector<__VA_ARGS__>;                                      \
+    PP_NDARRAY_EXTERN template std::string BaseVector<__VA_ARGS__>::toString<__VA_ARGS__>(int) const;
+
+#define PP_NDARRAY_INSTANTIATE_KERNELS(type, dim)                                                    \
+    PP_NDARRAY_EXTERN template struct Inner<type, dim>;                                             \
+    PP_NDARRAY_EXTERN template void fill<type, dim>(Inner<type, dim>&, const type&);                \
+    PP_NDARRAY_EXTERN template void copyto<type, dim>(Inner<type, dim>&, const Inner<type, dim>&);  \
+    PP_NDARRAY_EXTERN template std::size_t count_nonzero<type, dim>(const Inner<type, dim>&);       \
+    PP_NDARRAY_EXTERN template type sum<type, dim>(const Inner<type, dim>&);
+
+#define PP_NDARRAY_INSTANTIATE_AXIS(type, dim)                                                       \
+    PP_NDARRAY_INSTANTIATE_VECTOR(Inner<type, dim - 1>)                                             \
+    PP_NDARRAY_INSTANTIATE_KERNELS(type, dim)                                                       \
+    PP_NDARRAY_EXTERN template Inner<type, dim - 1> sum<type, dim>(const Inner<type, dim>&, std::size_t); \
+    PP_NDARRAY_EXTERN template void sum<type, dim>(const Inner<type, dim>&, std::size_t, Inner<type, dim - 1>&);
+
+#define PP_NDARRAY_INSTANTIATE_TYPE(name, type)                                                      \
+    PP_NDARRAY_INSTANTIATE_VECTOR(type)                                                             \
+    PP_NDARRAY_INSTANTIATE_KERNELS(type, 1)                                                         \
+    PP_NDARRAY_INSTANTIATE_AXIS(type, 2)                                                            \
+    PP_NDARRAY_INSTANTIATE_AXIS(type, 3)                                                            \
+    PP_NDARRAY_EXTERN template Inner<type, 2> matmul<type>(const Inner<type, 2>&, const Inner<type, 2>&, Workspace&); \
+    PP_NDARRAY_EXTERN template void matmul<type>(const Inner<type, 2>&, const Inner<type, 2>&, Inner<type, 2>&, Workspace&); \
+    PP_NDARRAY_EXTERN template class DynArray<type>;                                                \
+    PP_NDARRAY_EXTERN template void fill<type>(DynArray<type>&, const type&);                       \
+    PP_NDARRAY_EXTERN template void copyto<type>(DynArray<type>&, const DynArray<type>&);           \
+    PP_NDARRAY_EXTERN template type sum<type>(const DynArray<type>&);                               \
+    PP_NDARRAY_EXTERN template std::size_t count_nonzero<type>(const DynArray<type>&);              \
+    PP_NDARRAY_EXTERN template struct detail::AnyKernelsOf<type>;
+
+    PP_NDARRAY_SCALAR_TYPES(PP_NDARRAY_INSTANTIATE_TYPE)
+
+#undef PP_NDARRAY_INSTANTIATE_TYPE
+#undef PP_NDARRAY_INSTANTIATE_AXIS
+#undef PP_NDARRAY_INSTANTIATE_KERNELS
+#undef PP_NDARRAY_INSTANTIATE_VECTOR
+#undef PP_NDARRAY_EXTERN
+
+    /** @} */
+#endif
 }
 
 #endif